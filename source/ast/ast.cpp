@@ -2,167 +2,557 @@
 
 const char INDENT_SIZE = 2;
 
-void print_ast(const Ast* ast, FILE* stream)
+// An arena that streams its statements is compacted once it has this many more nodes.
+static constexpr size_t COMPACT_NODES = size_t(1) << 14;
+
+AstArena::AstArena()
+    : m_blocks(1)
+{
+}
+
+Ast* AstArena::root()
+{
+    return &m_blocks.front();
+}
+
+const Ast* AstArena::root() const
+{
+    return &m_blocks.front();
+}
+
+/*
+ * @brief   Appends a new block that is nested in 'block' and becomes its child.
+ */
+Ast* AstArena::add_child(Ast* block)
+{
+    assert(m_blocks.size() < NO_BLOCK);
+
+    auto& child  = m_blocks.emplace_back();
+    child.index  = AstIndex(m_blocks.size() - 1);
+    child.parent = block->index;
+    block->child = child.index;
+
+    return &child;
+}
+
+Ast* AstArena::child(const Ast* block)
+{
+    return block->child == NO_BLOCK ? nullptr : &m_blocks[block->child];
+}
+
+Ast* AstArena::parent(const Ast* block)
+{
+    return block->parent == NO_BLOCK ? nullptr : &m_blocks[block->parent];
+}
+
+size_t AstArena::size() const
+{
+    return m_blocks.size();
+}
+
+Expression AstArena::expression(ExpressionNode node)
+{
+    assert(m_expressions.size() < NO_BLOCK);
+
+    m_expressions.push_back(std::move(node));
+    return Expression{AstIndex(m_expressions.size() - 1)};
+}
+
+Statement AstArena::statement(StatementNode node)
+{
+    assert(m_statements.size() < NO_BLOCK);
+
+    m_statements.push_back(std::move(node));
+    return Statement{AstIndex(m_statements.size() - 1)};
+}
+
+ExpressionNode& AstArena::operator[](Expression expression)
+{
+    return m_expressions[expression.index];
+}
+
+const ExpressionNode& AstArena::operator[](Expression expression) const
+{
+    return m_expressions[expression.index];
+}
+
+StatementNode& AstArena::operator[](Statement statement)
+{
+    return m_statements[statement.index];
+}
+
+const StatementNode& AstArena::operator[](Statement statement) const
 {
-    StringBuffer buffer;
+    return m_statements[statement.index];
+}
+
+AstText AstArena::text(StringView text)
+{
+    assert(m_text.size() + text.size() < NO_BLOCK);
+
+    const auto first = AstIndex(m_text.size());
+    m_text.append(text);
+
+    return AstText{first, AstIndex(text.size())};
+}
+
+StringView AstArena::text(AstText text) const
+{
+    return StringView(m_text).substr(text.first, text.size);
+}
+
+/*
+ * Calls 'field' for every index, range, and text of a node. The embedded comparison of a
+ * condition block or a loop is passed as AstOperation.
+ */
+
+template<typename F>
+static void for_each_field(Closure& closure, F& field)
+{
+    field(closure.statements);
+    field(closure.arguments);
+}
+
+template<typename F>
+static void for_each_field(Dotted& dotted, F& field)
+{
+    field(dotted.ex);
+}
+
+template<typename F>
+static void for_each_field(Identifier& identifier, F& field)
+{
+    field(identifier.name);
+}
+
+template<typename F>
+static void for_each_field(Indexed& indexed, F& field)
+{
+    field(indexed.ex);
+}
+
+template<typename F>
+static void for_each_field(AstInt&, F&)
+{
+}
+
+template<typename F>
+static void for_each_field(AstList& list, F& field)
+{
+    field(list.elements);
+}
+
+template<typename F>
+static void for_each_field(AstMap& map, F& field)
+{
+    field(map.pairs);
+}
+
+template<typename F>
+static void for_each_field(AstNumber&, F&)
+{
+}
+
+template<typename F>
+static void for_each_field(AstOperation& operation, F& field)
+{
+    field(operation.ex);
+}
+
+template<typename F>
+static void for_each_field(AstString& string, F& field)
+{
+    field(string.value);
+}
+
+template<typename F>
+static void for_each_field(AstTable& table, F& field)
+{
+    field(table.name);
+    field(table.pairs);
+}
+
+template<typename F>
+static void for_each_field(Call& call, F& field)
+{
+    field(call.caller);
+    field(call.arguments);
+}
+
+template<typename F>
+static void for_each_field(Assignment& assignment, F& field)
+{
+    field(assignment.left);
+    field(assignment.right);
+}
+
+template<typename F>
+static void for_each_field(ConditionBlock& block, F& field)
+{
+    field(block.comparison);
+    field(block.statements);
+}
+
+template<typename F>
+static void for_each_field(Condition& condition, F& field)
+{
+    field(condition.blocks);
+}
+
+template<typename F>
+static void for_each_field(ForLoop& loop, F& field)
+{
+    field(loop.counter);
+    field(loop.begin);
+    field(loop.end);
+    field(loop.increment);
+    field(loop.statements);
+}
+
+template<typename F>
+static void for_each_field(ForInLoop& loop, F& field)
+{
+    field(loop.key);
+    field(loop.value);
+    field(loop.table);
+    field(loop.statements);
+}
+
+template<typename F>
+static void for_each_field(LocalDefinition& definition, F& field)
+{
+    field(definition.left);
+    field(definition.right);
+}
+
+template<typename F>
+static void for_each_field(Return& ret, F& field)
+{
+    field(ret.ex);
+}
+
+template<typename F>
+static void for_each_field(TailCall& call, F& field)
+{
+    field(call.caller);
+    field(call.arguments);
+}
+
+template<typename F>
+static void for_each_field(WhileLoop& loop, F& field)
+{
+    field(loop.condition);
+    field(loop.statements);
+}
+
+/*
+ * Copies nodes from one arena into another. Both can be the same arena, so a node is
+ * copied out before its children are added, and a range is read again for every element.
+ * Texts never change and are shared within an arena.
+ */
+struct AstCopy
+{
+    const AstArena& from;
+    AstArena&       to;
+
+    void operator()(AstText& text)
+    {
+        if(&from != &to)
+            text = to.text(from.text(text));
+    }
+
+    void operator()(Expression& expression)
+    {
+        auto node = from[expression];
+        std::visit([this](auto& n) { for_each_field(n, *this); }, node);
+        expression = to.expression(std::move(node));
+    }
+
+    void operator()(Statement& statement)
+    {
+        auto node = from[statement];
+        std::visit([this](auto& n) { for_each_field(n, *this); }, node);
+        statement = to.statement(std::move(node));
+    }
+
+    void operator()(AstOperation& operation)
+    {
+        for_each_field(operation, *this);
+    }
+
+    void operator()(ConditionBlock& block)
+    {
+        for_each_field(block, *this);
+    }
+
+    template<typename T>
+    void operator()(AstRange<T>& range)
+    {
+        Vector<T> elements;
+        elements.reserve(range.size);
+
+        for(AstIndex i = 0; i < range.size; ++i)
+        {
+            auto element = from.items(range)[i];
+            (*this)(element);
+            elements.push_back(std::move(element));
+        }
+
+        range = to.list(elements);
+    }
+};
+
+Expression AstArena::copy(const AstArena& from, Expression expression)
+{
+    auto copier = AstCopy{from, *this};
+    copier(expression);
+
+    return expression;
+}
+
+Statements AstArena::copy(const AstArena& from, Statements statements)
+{
+    auto copier = AstCopy{from, *this};
+    copier(statements);
+
+    return statements;
+}
+
+size_t AstArena::nodes() const
+{
+    return m_expressions.size() + m_statements.size();
+}
+
+/*
+ * @brief   The kept nodes are copied into a new arena whose nodes replace the ones of this
+ *          arena. Every block but the root was left when the root block is parsed.
+ */
+void AstArena::compact(Vector<Statement>& statements, Vector<AstElement>& elements)
+{
+    if(nodes() < 2 * m_compacted + COMPACT_NODES)
+        return;
+
+    auto kept   = AstArena();
+    auto copier = AstCopy{*this, kept};
+
+    for(auto& statement : statements)
+        copier(statement);
+
+    for(auto& element : elements)
+        std::visit(copier, element);
+
+    m_expressions      = std::move(kept.m_expressions);
+    m_statements       = std::move(kept.m_statements);
+    m_expression_lists = std::move(kept.m_expression_lists);
+    m_statement_lists  = std::move(kept.m_statement_lists);
+    m_condition_blocks = std::move(kept.m_condition_blocks);
+    m_text             = std::move(kept.m_text);
+    m_compacted        = nodes();
+
+    m_blocks.resize(1);
+    m_blocks.front().child = NO_BLOCK;
+}
+
+void AstArena::clear()
+{
+    m_blocks.resize(1);
+
+    auto& root   = m_blocks.front();
+    root.child   = NO_BLOCK;
+    root.context = Context();
+    root.statements.clear();
+
+    m_expressions.clear();
+    m_statements.clear();
+    m_expression_lists.clear();
+    m_statement_lists.clear();
+    m_condition_blocks.clear();
+    m_text.clear();
+    m_compacted = 0;
+}
+
+void print_ast(const AstArena& ast, FILE* stream)
+{
+    StringBuffer buffer(stream);
     print_ast(ast, buffer);
-    fprintf(stream, buffer.str().c_str());
+    buffer.flush();
 }
 
-void print_ast(const Ast* ast, StringBuffer& buffer)
+void print_ast(const AstArena& ast, StringBuffer& buffer)
 {
-    print_statements(ast->statements, buffer, 0);
+    const auto& statements = ast.root()->statements;
+    print_statements(
+        ast, AstView<const Statement>(statements.data(), statements.size()), buffer, 0);
 }
 
 void print_indent(StringBuffer& buffer, const int indent)
 {
-    buffer << std::string(indent * INDENT_SIZE, ' ');
+    buffer.spaces(indent * INDENT_SIZE);
 }
 
-void print_statements(const std::vector<Statement>& statements, StringBuffer& buffer, const int indent)
+void print_statements(
+    const AstArena&          ast,
+    AstView<const Statement> statements,
+    StringBuffer&            buffer,
+    const int                indent)
 {
-    for(const auto& statement : statements)
+    for(const auto statement : statements)
     {
-        print_statement(statement, buffer, indent);
+        print_statement(ast, statement, buffer, indent);
         buffer << "\n";
     }
 }
 
-void print_statement(const Statement& statement, StringBuffer& buffer, const int indent)
+void print_statement(const AstArena& ast, Statement statement, StringBuffer& buffer, const int indent)
 {
-    std::visit([&buffer, indent](auto&& s) { print(s, buffer, indent); }, statement);
+    std::visit([&](auto&& s) { print(ast, s, buffer, indent); }, ast[statement]);
 }
 
-void print_expression(const Expression& expression, StringBuffer& buffer, const int indent)
+void print_expression(const AstArena& ast, Expression expression, StringBuffer& buffer, const int indent)
 {
-    std::visit([&buffer, indent](auto&& e) { print(e, buffer, indent); }, expression);
+    std::visit([&](auto&& e) { print(ast, e, buffer, indent); }, ast[expression]);
 }
 
 // Expressions
 
-void print(const Closure& closure, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Closure& closure, StringBuffer& buffer, const int indent)
 {
     buffer << "function(";
 
-    for(const auto& arg : closure.arguments)
+    const auto arguments = ast.items(closure.arguments);
+    for(const auto& arg : arguments)
     {
-        print(arg, buffer, indent + 1);
+        print_expression(ast, arg, buffer, indent + 1);
 
-        if(&arg != &closure.arguments.back())
+        if(&arg != &arguments.back())
             buffer << ", ";
     }
 
     buffer << ")\n";
 
-    print_statements(closure.statements, buffer, indent + 1);
+    print_statements(ast, ast.items(closure.statements), buffer, indent + 1);
 
     print_indent(buffer, indent);
     buffer << "end";
 }
 
-void print(const Dotted& dotted, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Dotted& dotted, StringBuffer& buffer, const int indent)
 {
-    print_expression(dotted.ex[0], buffer, indent);
+    const auto ex = ast.items(dotted.ex);
+
+    print_expression(ast, ex[0], buffer, indent);
     buffer << ".";
-    print_expression(dotted.ex[1], buffer, 0);
+    print_expression(ast, ex[1], buffer, 0);
 }
 
-void print(const Identifier& identifier, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Identifier& identifier, StringBuffer& buffer, const int)
 {
-    buffer << identifier.name;
+    buffer << ast.text(identifier.name);
 }
 
-void print(const Indexed& indexed, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Indexed& indexed, StringBuffer& buffer, const int indent)
 {
-    print_expression(indexed.ex[0], buffer, indent);
+    const auto ex = ast.items(indexed.ex);
+
+    print_expression(ast, ex[0], buffer, indent);
     buffer << "[";
-    print_expression(indexed.ex[1], buffer, 0);
+    print_expression(ast, ex[1], buffer, 0);
     buffer << "]";
 }
 
-void print(const AstInt& number, StringBuffer& buffer, const int indent)
+void print(const AstArena&, const AstInt& number, StringBuffer& buffer, const int)
 {
     buffer << number.value;
 }
 
-void print(const AstList& list, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const AstList& list, StringBuffer& buffer, const int indent)
 {
+    const auto elements = ast.items(list.elements);
+
     buffer << "{";
-    for(const auto& el : list.elements)
+    for(const auto& el : elements)
     {
-        print_expression(el, buffer, indent);
+        print_expression(ast, el, buffer, indent);
 
-        if(&el != &list.elements.back())
+        if(&el != &elements.back())
             buffer << ", ";
     }
     buffer << "}";
 }
 
-void print(const AstMap& map, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const AstMap& map, StringBuffer& buffer, const int indent)
 {
+    const auto pairs = ast.items(map.pairs);
+
     buffer << "{";
-    for(const auto& p : map.pairs)
+    for(size_t i = 0; i + 1 < pairs.size(); i += 2)
     {
         print_indent(buffer, indent);
-        buffer << std::get<AstString>(p.first).value;
+        buffer << ast.text(std::get<AstString>(ast[pairs[i]]).value);
         buffer << " = ";
-        print_expression(p.second, buffer, indent);
+        print_expression(ast, pairs[i + 1], buffer, indent);
 
-        if(&p != &map.pairs.back())
+        if(i + 2 < pairs.size())
             buffer << ", ";
     }
     buffer << "}";
 }
 
-void print(const AstNumber& number, StringBuffer& buffer, const int indent)
+void print(const AstArena&, const AstNumber& number, StringBuffer& buffer, const int)
 {
     buffer << number.value;
 }
 
-void print(const AstOperation& operation, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const AstOperation& operation, StringBuffer& buffer, const int indent)
 {
-    if(operation.ex.size() == 1)
+    const auto ex = ast.items(operation.ex);
+
+    if(ex.size() == 1)
         buffer << operation.op;
 
-    auto it = operation.ex.begin();
-    while(it != operation.ex.end())
+    auto it = ex.begin();
+    while(it != ex.end())
     {
-        if(std::holds_alternative<AstOperation>(*it))
+        if(std::holds_alternative<AstOperation>(ast[*it]))
         {
             buffer << "(";
-            print_expression(*it, buffer, indent);
+            print_expression(ast, *it, buffer, indent);
             buffer << ")";
         }
         else
-            print_expression(*it, buffer, indent);
+            print_expression(ast, *it, buffer, indent);
 
         it++;
 
-        if(it != operation.ex.end())
+        if(it != ex.end())
             buffer << " " << operation.op << " ";
     }
 }
 
-void print(const AstString& string, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const AstString& string, StringBuffer& buffer, const int)
 {
-    buffer << "\"" << string.value << "\"";
+    buffer << "\"" << ast.text(string.value) << "\"";
 }
 
-void print(const AstTable& table, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const AstTable& table, StringBuffer& buffer, const int indent)
 {
-    buffer << table.name.name.c_str() << " {\n";
-    for(const auto& p : table.pairs)
+    const auto pairs = ast.items(table.pairs);
+
+    buffer << ast.text(table.name) << " {\n";
+    for(size_t i = 0; i + 1 < pairs.size(); i += 2)
     {
+        const auto& key = ast[pairs[i]];
+
         print_indent(buffer, indent + 1);
-        if(std::holds_alternative<AstString>(p.first))
-            buffer << std::get<AstString>(p.first).value;
-        else if(std::holds_alternative<Identifier>(p.first))
-            buffer << std::get<Identifier>(p.first).name;
+        if(std::holds_alternative<AstString>(key))
+            buffer << ast.text(std::get<AstString>(key).value);
+        else if(std::holds_alternative<Identifier>(key))
+            buffer << ast.text(std::get<Identifier>(key).name);
 
         buffer << " = ";
-        print_expression(p.second, buffer, indent + 1);
+        print_expression(ast, pairs[i + 1], buffer, indent + 1);
 
-        if(&p != &table.pairs.back())
+        if(i + 2 < pairs.size())
             buffer << ",\n";
     }
     buffer << "\n";
@@ -172,16 +562,18 @@ void print(const AstTable& table, StringBuffer& buffer, const int indent)
 
 // Statements
 
-void print(const Assignment& assignment, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Assignment& assignment, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
 
-    auto lit = assignment.left.begin();
-    while(lit != assignment.left.end())
+    const auto left = ast.items(assignment.left);
+
+    auto lit = left.begin();
+    while(lit != left.end())
     {
-        buffer << lit->name;
+        print_expression(ast, *lit, buffer, 0);
 
-        if(lit != assignment.left.end() - 1)
+        if(lit != left.end() - 1)
             buffer << ", ";
 
         lit++;
@@ -189,32 +581,36 @@ void print(const Assignment& assignment, StringBuffer& buffer, const int indent)
 
     buffer << " = ";
 
-    auto rit = assignment.right.begin();
-    while(rit != assignment.right.end())
+    const auto right = ast.items(assignment.right);
+
+    auto rit = right.begin();
+    while(rit != right.end())
     {
-        print_expression(*rit, buffer, 0);
+        print_expression(ast, *rit, buffer, 0);
 
-        if(rit != assignment.right.end() - 1)
+        if(rit != right.end() - 1)
             buffer << ", ";
 
         rit++;
     }
 }
 
-void print(const Call& call, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Call& call, StringBuffer& buffer, const int indent)
 {
     if(!(call.return_values > 0))
         print_indent(buffer, indent);
 
-    print_expression(call.caller[0], buffer, 0);
+    print_expression(ast, ast.items(call.caller)[0], buffer, 0);
+
+    const auto arguments = ast.items(call.arguments);
 
     buffer << "(";
-    auto it = call.arguments.begin();
-    while(it != call.arguments.end())
+    auto it = arguments.begin();
+    while(it != arguments.end())
     {
-        print_expression(*it, buffer, 0);
+        print_expression(ast, *it, buffer, 0);
 
-        if(it != call.arguments.end() - 1)
+        if(it != arguments.end() - 1)
             buffer << ", ";
 
         it++;
@@ -222,30 +618,32 @@ void print(const Call& call, StringBuffer& buffer, const int indent)
     buffer << ")";
 }
 
-void print(const Condition& condition, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Condition& condition, StringBuffer& buffer, const int indent)
 {
-    for(auto it = condition.blocks.begin(); it != condition.blocks.end(); ++it)
+    const auto blocks = ast.items(condition.blocks);
+
+    for(auto it = blocks.begin(); it != blocks.end(); ++it)
     {
         print_indent(buffer, indent);
 
-        if(it == condition.blocks.begin())
+        if(it == blocks.begin())
         {
             buffer << "if ";
-            print(it->comparison, buffer, indent);
+            print(ast, it->comparison, buffer, indent);
             buffer << " then\n";
-            print_statements(it->statements, buffer, indent + 1);
+            print_statements(ast, ast.items(it->statements), buffer, indent + 1);
         }
         else if(!it->comparison.empty())
         {
             buffer << "elseif ";
-            print(it->comparison, buffer, indent);
+            print(ast, it->comparison, buffer, indent);
             buffer << " then\n";
-            print_statements(it->statements, buffer, indent + 1);
+            print_statements(ast, ast.items(it->statements), buffer, indent + 1);
         }
         else
         {
             buffer << "else\n";
-            print_statements(it->statements, buffer, indent + 1);
+            print_statements(ast, ast.items(it->statements), buffer, indent + 1);
         }
     }
 
@@ -253,98 +651,106 @@ void print(const Condition& condition, StringBuffer& buffer, const int indent)
     buffer << "end";
 }
 
-void print(const ForLoop& loop, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const ForLoop& loop, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
-    buffer << "for " << loop.counter << " = ";
+    buffer << "for " << ast.text(loop.counter) << " = ";
 
-    print_expression(loop.begin, buffer, 0);
+    print_expression(ast, loop.begin, buffer, 0);
     buffer << " , ";
-    print_expression(loop.end, buffer, 0);
+    print_expression(ast, loop.end, buffer, 0);
     buffer << " , ";
-    print_expression(loop.increment, buffer, 0);
+    print_expression(ast, loop.increment, buffer, 0);
 
     buffer << " do\n";
 
-    print_statements(loop.statements, buffer, indent + 1);
+    print_statements(ast, ast.items(loop.statements), buffer, indent + 1);
 
     print_indent(buffer, indent);
     buffer << "end";
 }
 
-void print(const ForInLoop& loop, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const ForInLoop& loop, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
-    buffer << "for " << loop.key << " , " << loop.value << " in ";
+    buffer << "for " << ast.text(loop.key) << " , " << ast.text(loop.value) << " in ";
 
-    print_expression(loop.table, buffer, 0);
+    print_expression(ast, loop.table, buffer, 0);
 
     buffer << " do\n";
 
-    print_statements(loop.statements, buffer, indent + 1);
+    print_statements(ast, ast.items(loop.statements), buffer, indent + 1);
 
     print_indent(buffer, indent);
     buffer << "end";
 }
 
-void print(const LocalDefinition& definition, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const LocalDefinition& definition, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
     buffer << "local ";
 
-    auto key = definition.left.begin();
-    while(key != definition.left.end())
+    const auto left = ast.items(definition.left);
+
+    auto key = left.begin();
+    while(key != left.end())
     {
-        buffer << key->name;
-        if(key != definition.left.end() - 1)
+        print_expression(ast, *key, buffer, 0);
+        if(key != left.end() - 1)
             buffer << ", ";
         key++;
     }
 
     buffer << " = ";
 
-    auto val = definition.right.begin();
-    while(val != definition.right.end())
+    const auto right = ast.items(definition.right);
+
+    auto val = right.begin();
+    while(val != right.end())
     {
-        print_expression(*val, buffer, indent);
-        if(val != definition.right.end() - 1)
+        print_expression(ast, *val, buffer, indent);
+        if(val != right.end() - 1)
             buffer << ", ";
         val++;
     }
 }
 
-void print(const Return& ret, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const Return& ret, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
     buffer << "return ";
 
-    auto it = ret.ex.begin();
-    while(it != ret.ex.end())
+    const auto ex = ast.items(ret.ex);
+
+    auto it = ex.begin();
+    while(it != ex.end())
     {
-        print_expression(*it, buffer, indent);
+        print_expression(ast, *it, buffer, indent);
 
-        if(it != ret.ex.end() - 1)
+        if(it != ex.end() - 1)
             buffer << ", ";
 
         it++;
     }
 }
 
-void print(const TailCall& call, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const TailCall& call, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
 
     buffer << "return ";
 
-    print_expression(call.caller[0], buffer, indent);
+    print_expression(ast, ast.items(call.caller)[0], buffer, indent);
+
+    const auto arguments = ast.items(call.arguments);
 
     buffer << "(";
-    auto it = call.arguments.begin();
-    while(it != call.arguments.end())
+    auto it = arguments.begin();
+    while(it != arguments.end())
     {
-        print_expression(*it, buffer, indent);
+        print_expression(ast, *it, buffer, indent);
 
-        if(it != call.arguments.end() - 1)
+        if(it != arguments.end() - 1)
             buffer << ", ";
 
         it++;
@@ -352,15 +758,81 @@ void print(const TailCall& call, StringBuffer& buffer, const int indent)
     buffer << ")";
 }
 
-void print(const WhileLoop& loop, StringBuffer& buffer, const int indent)
+void print(const AstArena& ast, const WhileLoop& loop, StringBuffer& buffer, const int indent)
 {
     print_indent(buffer, indent);
     buffer << "while ";
-    print(loop.condition, buffer, indent);
+    print(ast, loop.condition, buffer, indent);
     buffer << " do\n";
 
-    print_statements(loop.statements, buffer, indent + 1);
+    print_statements(ast, ast.items(loop.statements), buffer, indent + 1);
 
     print_indent(buffer, indent);
     buffer << "end";
 }
+
+// Counting
+
+/*
+ * Counts the nodes below the ones it is called for. The comparison of a condition block
+ * or a loop counts as an expression.
+ */
+struct AstCounter
+{
+    const AstArena& ast;
+    AstCount&       nodes;
+
+    void operator()(AstText&)
+    {
+    }
+
+    void operator()(Expression& expression)
+    {
+        nodes.expressions += 1;
+
+        auto node = ast[expression];
+        std::visit([this](auto& n) { for_each_field(n, *this); }, node);
+    }
+
+    void operator()(Statement& statement)
+    {
+        nodes.statements += 1;
+
+        auto node = ast[statement];
+        std::visit([this](auto& n) { for_each_field(n, *this); }, node);
+    }
+
+    void operator()(AstOperation& operation)
+    {
+        nodes.expressions += 1;
+        for_each_field(operation, *this);
+    }
+
+    void operator()(ConditionBlock& block)
+    {
+        for_each_field(block, *this);
+    }
+
+    template<typename T>
+    void operator()(AstRange<T>& range)
+    {
+        for(auto element : ast.items(range))
+            (*this)(element);
+    }
+};
+
+/*
+ * @brief   Blocks are counted in the arena, statements and expressions in the tree below
+ *          the root block.
+ */
+AstCount count_nodes(const AstArena& ast)
+{
+    AstCount nodes;
+    nodes.blocks = ast.size();
+
+    auto counter = AstCounter{ast, nodes};
+    for(auto statement : ast.root()->statements)
+        counter(statement);
+
+    return nodes;
+}
@@ -1,68 +1,116 @@
 #ifndef LUA4DEC_AST_H
 #define LUA4DEC_AST_H
 
+#include "io/io.hpp"
 #include "lua/lua.hpp"
 
-#include <sstream>
+#include <deque>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
-using StringBuffer = std::stringstream;
-
-struct Closure;
-struct Dotted;
-struct Identifier;
-struct Indexed;
-struct AstInt;
-struct AstList;
-struct AstMap;
-struct AstNumber;
-struct AstOperation;
-struct AstString;
-struct AstTable;
-
-struct Assignment;
-struct Call;
-struct Condition;
-struct ForLoop;
-struct ForInLoop;
-struct LocalDefinition;
-struct Return;
-struct TailCall;
-struct WhileLoop;
-
-using Expression =
-    std::variant<Call, Closure, Dotted, Identifier, Indexed, AstInt, AstList, AstMap, AstNumber, AstOperation, AstString, AstTable>;
-using Statement =
-    std::variant<Assignment, Call, Condition, ForLoop, ForInLoop, LocalDefinition, Return, TailCall, WhileLoop>;
+using AstIndex = uint32_t;
+
+constexpr AstIndex NO_BLOCK = std::numeric_limits<AstIndex>::max();
+
+/*
+ * Every node of the AST lives in the arena of its chunk, and nodes refer to each other by
+ * 32 bit index. An Expression or a Statement is the index of a node. A range is the
+ * position of consecutive indices (or condition blocks) in the arena, a text the position
+ * of a name or a string in the characters of the arena.
+ */
+struct Expression
+{
+    AstIndex index = 0;
+};
+
+struct Statement
+{
+    AstIndex index = 0;
+};
+
 using AstElement = std::variant<Statement, Expression>;
 
-struct Context
+template<typename T>
+struct AstRange
 {
-    unsigned jump_offset  = 0;
-    unsigned jmp_offset   = 0;
-    bool     is_jmp       = false;
-    bool     is_condition = false;
-    bool     is_jmp_block = false;
-    bool     is_or_block  = false;
+    AstIndex first = 0;
+    AstIndex size  = 0;
 };
 
-struct Ast
+struct AstText
 {
-    Ast*              child;
-    Ast*              parent;
-    Context           context;
-    Vector<Statement> statements;
+    AstIndex first = 0;
+    AstIndex size  = 0;
+};
+
+struct ConditionBlock;
+
+using Expressions     = AstRange<Expression>;
+using Statements      = AstRange<Statement>;
+using ConditionBlocks = AstRange<ConditionBlock>;
+
+/*
+ * The elements of a range. A view is valid until the next node is added to the arena.
+ */
+template<typename T>
+class AstView
+{
+public:
+    AstView(T* first, size_t size)
+        : m_first(first)
+        , m_last(first + size)
+    {
+    }
+
+    T* begin() const
+    {
+        return m_first;
+    }
+
+    T* end() const
+    {
+        return m_last;
+    }
+
+    size_t size() const
+    {
+        return size_t(m_last - m_first);
+    }
+
+    bool empty() const
+    {
+        return m_first == m_last;
+    }
+
+    T& operator[](size_t i) const
+    {
+        return m_first[i];
+    }
+
+    T& front() const
+    {
+        return *m_first;
+    }
+
+    T& back() const
+    {
+        return *(m_last - 1);
+    }
+
+private:
+    T* m_first;
+    T* m_last;
 };
 
 // Expressions
 
 struct Closure
 {
-    Vector<Statement>  statements;
-    Vector<Identifier> arguments;
+    Statements  statements;
+    Expressions arguments;  // identifiers
 
-    Closure(const Vector<Statement>& s, const Vector<Identifier> a)
+    Closure(Statements s, Expressions a)
         : statements(s)
         , arguments(a)
     {
@@ -71,9 +119,9 @@ struct Closure
 
 struct Dotted
 {
-    Vector<Expression> ex;
+    Expressions ex;
 
-    Dotted(const Vector<Expression>& e)
+    Dotted(Expressions e)
         : ex(e)
     {
     }
@@ -81,9 +129,9 @@ struct Dotted
 
 struct Identifier
 {
-    String name;
+    AstText name;
 
-    Identifier(const String& n)
+    Identifier(AstText n)
         : name(n)
     {
     }
@@ -91,9 +139,9 @@ struct Identifier
 
 struct Indexed
 {
-    Vector<Expression> ex;
+    Expressions ex;
 
-    Indexed(const Vector<Expression>& e)
+    Indexed(Expressions e)
         : ex(e)
     {
     }
@@ -111,9 +159,9 @@ struct AstInt
 
 struct AstList
 {
-    Vector<Expression> elements;
+    Expressions elements;
 
-    AstList(const Vector<Expression>& e)
+    AstList(Expressions e)
         : elements(e)
     {
     }
@@ -121,9 +169,9 @@ struct AstList
 
 struct AstMap
 {
-    Vector<std::pair<Expression, Expression>> pairs;
+    Expressions pairs;  // key, value, key, value, ...
 
-    AstMap(const Vector<std::pair<Expression, Expression>>& p)
+    AstMap(Expressions p)
         : pairs(p)
     {
     }
@@ -141,10 +189,10 @@ struct AstNumber
 
 struct AstOperation
 {
-    std::string        op;
-    Vector<Expression> ex;
+    StringView  op;  // a string literal
+    Expressions ex;
 
-    AstOperation(const std::string& o, const Vector<Expression>& e)
+    AstOperation(StringView o, Expressions e)
         : op(o)
         , ex(e)
     {
@@ -152,15 +200,15 @@ struct AstOperation
 
     bool empty() const
     {
-        return op.empty() && ex.empty();
+        return op.empty() && ex.size == 0;
     }
 };
 
 struct AstString
 {
-    String value;
+    AstText value;
 
-    AstString(const String& v)
+    AstString(AstText v)
         : value(v)
     {
     }
@@ -168,16 +216,13 @@ struct AstString
 
 struct AstTable
 {
-    Identifier                                name;
-    unsigned                                  size;
-    Vector<std::pair<Expression, Expression>> pairs;
+    AstText     name;
+    unsigned    size;
+    Expressions pairs;  // key, value, key, value, ...
 
-    AstTable(
-        const unsigned                                   s,
-        const Identifier&                                n,
-        const Vector<std::pair<Expression, Expression>>& p)
-        : size(s)
-        , name(n)
+    AstTable(const unsigned s, AstText n, Expressions p)
+        : name(n)
+        , size(s)
         , pairs(p)
     {
     }
@@ -185,11 +230,11 @@ struct AstTable
 
 struct Call
 {
-    Vector<Expression> caller;
-    Vector<Expression> arguments;
-    unsigned           return_values;
+    Expressions caller;
+    Expressions arguments;
+    unsigned    return_values;
 
-    Call(const Vector<Expression>& c, const Vector<Expression>& a, const unsigned r = 0)
+    Call(Expressions c, Expressions a, const unsigned r = 0)
         : caller(c)
         , arguments(a)
         , return_values(r)
@@ -201,16 +246,12 @@ struct Call
 
 struct Assignment
 {
-    Vector<Identifier> left;
-    Vector<Expression> right;
-    unsigned           num_variables;
-    unsigned           num_values;
+    Expressions left;  // identifiers
+    Expressions right;
+    unsigned    num_variables;
+    unsigned    num_values;
 
-    Assignment(
-        const Vector<Identifier>& i,
-        const Vector<Expression>& e,
-        const unsigned            vars = 1,
-        const unsigned            vals = 1)
+    Assignment(Expressions i, Expressions e, const unsigned vars = 1, const unsigned vals = 1)
         : left(i)
         , right(e)
         , num_variables(vars)
@@ -221,10 +262,10 @@ struct Assignment
 
 struct ConditionBlock
 {
-    AstOperation      comparison;
-    Vector<Statement> statements;
+    AstOperation comparison;
+    Statements   statements;
 
-    ConditionBlock(const AstOperation& o, const Vector<Statement>& s)
+    ConditionBlock(AstOperation o, Statements s)
         : comparison(o)
         , statements(s)
     {
@@ -233,9 +274,9 @@ struct ConditionBlock
 
 struct Condition
 {
-    Vector<ConditionBlock> blocks;
+    ConditionBlocks blocks;
 
-    Condition(const Vector<ConditionBlock>& c)
+    Condition(ConditionBlocks c)
         : blocks(c)
     {
     }
@@ -243,18 +284,13 @@ struct Condition
 
 struct ForLoop
 {
-    String            counter;
-    Expression        begin;
-    Expression        end;
-    Expression        increment;
-    Vector<Statement> statements;
+    AstText    counter;
+    Expression begin;
+    Expression end;
+    Expression increment;
+    Statements statements;
 
-    ForLoop(
-        const String&            c,
-        const Expression         b,
-        const Expression         e,
-        const Expression         i,
-        const Vector<Statement>& s)
+    ForLoop(AstText c, Expression b, Expression e, Expression i, Statements s)
         : counter(c)
         , begin(b)
         , end(e)
@@ -266,12 +302,12 @@ struct ForLoop
 
 struct ForInLoop
 {
-    String            key;
-    String            value;
-    Expression        table;
-    Vector<Statement> statements;
+    AstText    key;
+    AstText    value;
+    Expression table;
+    Statements statements;
 
-    ForInLoop(const String& k, const String& v, const Expression& t, const Vector<Statement>& s)
+    ForInLoop(AstText k, AstText v, Expression t, Statements s)
         : key(k)
         , value(v)
         , table(t)
@@ -282,10 +318,10 @@ struct ForInLoop
 
 struct LocalDefinition
 {
-    Vector<Identifier> left;
-    Vector<Expression> right;
+    Expressions left;  // identifiers
+    Expressions right;
 
-    LocalDefinition(const Vector<Identifier>& l, const Vector<Expression>& r)
+    LocalDefinition(Expressions l, Expressions r)
         : left(l)
         , right(r)
     {
@@ -294,9 +330,9 @@ struct LocalDefinition
 
 struct Return
 {
-    Vector<Expression> ex;
+    Expressions ex;
 
-    Return(const Vector<Expression>& e)
+    Return(Expressions e)
         : ex(e)
     {
     }
@@ -304,10 +340,10 @@ struct Return
 
 struct TailCall
 {
-    Vector<Expression> caller;
-    Vector<Expression> arguments;
+    Expressions caller;
+    Expressions arguments;
 
-    TailCall(const Vector<Expression>& c, const Vector<Expression>& a)
+    TailCall(Expressions c, Expressions a)
         : caller(c)
         , arguments(a)
     {
@@ -316,50 +352,264 @@ struct TailCall
 
 struct WhileLoop
 {
-    AstOperation      condition;
-    Vector<Statement> statements;
+    AstOperation condition;
+    Statements   statements;
 
-    WhileLoop(const AstOperation& o, const Vector<Statement>& s)
+    WhileLoop(AstOperation o, Statements s)
         : condition(o)
         , statements(s)
     {
     }
 };
 
+using ExpressionNode =
+    std::variant<Call, Closure, Dotted, Identifier, Indexed, AstInt, AstList, AstMap, AstNumber, AstOperation, AstString, AstTable>;
+using StatementNode =
+    std::variant<Assignment, Call, Condition, ForLoop, ForInLoop, LocalDefinition, Return, TailCall, WhileLoop>;
+
+struct Context
+{
+    unsigned jump_offset  = 0;
+    unsigned jmp_offset   = 0;
+    bool     is_jmp       = false;
+    bool     is_condition = false;
+    bool     is_jmp_block = false;
+    bool     is_or_block  = false;
+};
+
+/*
+ * A block of statements that is being parsed. Blocks refer to the block they are nested
+ * in and to the block that was entered last from them by their index in the arena. The
+ * statements of a block are stored as a range once the block is complete.
+ */
+struct Ast
+{
+    AstIndex          index  = 0;
+    AstIndex          child  = NO_BLOCK;
+    AstIndex          parent = NO_BLOCK;
+    Context           context;
+    Vector<Statement> statements;
+};
+
+/*
+ * Owns the whole AST of one chunk: the blocks, starting with the root block, and every
+ * node, range and text. Nodes of one kind are stored next to each other and are never
+ * removed, so the tree is freed at once with the arena, or cleared at once to reuse the
+ * arena. Blocks do not move while the tree grows, nodes and ranges can, references to
+ * them are only valid until the next node is added.
+ */
+class AstArena
+{
+public:
+    AstArena();
+
+    Ast*       root();
+    const Ast* root() const;
+
+    Ast* add_child(Ast* block);
+    Ast* child(const Ast* block);
+    Ast* parent(const Ast* block);
+
+    size_t size() const;
+
+    Expression expression(ExpressionNode node);
+    Statement  statement(StatementNode node);
+
+    ExpressionNode&       operator[](Expression expression);
+    const ExpressionNode& operator[](Expression expression) const;
+    StatementNode&        operator[](Statement statement);
+    const StatementNode&  operator[](Statement statement) const;
+
+    AstText    text(StringView text);
+    StringView text(AstText text) const;
+
+    /*
+     * @brief   Stores the elements next to each other.
+     */
+    template<typename T>
+    AstRange<T> list(const Vector<T>& elements);
+
+    template<typename T>
+    AstRange<T> list(std::initializer_list<T> elements);
+
+    /*
+     * @brief   Appends an element to a range. A range that is not the last one of its kind
+     *          is moved behind the last one first.
+     */
+    template<typename T>
+    void append(AstRange<T>& range, T element);
+
+    template<typename T>
+    AstView<T> items(AstRange<T> range);
+
+    template<typename T>
+    AstView<const T> items(AstRange<T> range) const;
+
+    /*
+     * @brief   Copies the nodes below 'expression' or 'statements' of the arena 'from',
+     *          which can be this one, and returns the copy.
+     */
+    Expression copy(const AstArena& from, Expression expression);
+    Statements copy(const AstArena& from, Statements statements);
+
+    /*
+     * @brief   Number of expressions and statements, including the ones that are not part
+     *          of the tree anymore.
+     */
+    size_t nodes() const;
+
+    /*
+     * @brief   Drops every node that cannot be reached from 'statements' or 'elements'
+     *          and every block but the root, once the arena has grown enough since the
+     *          last time. Only called while the root block is parsed.
+     */
+    void compact(Vector<Statement>& statements, Vector<AstElement>& elements);
+
+    /*
+     * @brief   Removes every block but the root, which is emptied, and every node, so the
+     *          arena can hold the tree of another chunk.
+     */
+    void clear();
+
+private:
+    template<typename T>
+    Vector<T>& store();
+
+    template<typename T>
+    const Vector<T>& store() const;
+
+    template<typename T>
+    AstRange<T> list(const T* elements, size_t size);
+
+    std::deque<Ast>        m_blocks;
+    Vector<ExpressionNode> m_expressions;
+    Vector<StatementNode>  m_statements;
+    Vector<Expression>     m_expression_lists;
+    Vector<Statement>      m_statement_lists;
+    Vector<ConditionBlock> m_condition_blocks;
+    String                 m_text;
+    size_t                 m_compacted = 0;  // nodes after the last compaction
+};
+
+template<typename T>
+Vector<T>& AstArena::store()
+{
+    if constexpr(std::is_same_v<T, Expression>)
+        return m_expression_lists;
+    else if constexpr(std::is_same_v<T, Statement>)
+        return m_statement_lists;
+    else
+        return m_condition_blocks;
+}
+
+template<typename T>
+const Vector<T>& AstArena::store() const
+{
+    return const_cast<AstArena*>(this)->store<T>();
+}
+
+template<typename T>
+AstRange<T> AstArena::list(const T* elements, size_t size)
+{
+    auto& items = store<T>();
+    assert(items.size() + size < NO_BLOCK);
+
+    const auto first = AstIndex(items.size());
+    items.insert(items.end(), elements, elements + size);
+
+    return AstRange<T>{first, AstIndex(size)};
+}
+
+template<typename T>
+AstRange<T> AstArena::list(const Vector<T>& elements)
+{
+    return list(elements.data(), elements.size());
+}
+
+template<typename T>
+AstRange<T> AstArena::list(std::initializer_list<T> elements)
+{
+    return list(elements.begin(), elements.size());
+}
+
+template<typename T>
+void AstArena::append(AstRange<T>& range, T element)
+{
+    auto& items = store<T>();
+
+    if(range.first + range.size != items.size())
+    {
+        const auto first = AstIndex(items.size());
+        items.reserve(items.size() + range.size + 1);
+
+        for(AstIndex i = 0; i < range.size; ++i)
+            items.push_back(items[range.first + i]);
+
+        range.first = first;
+    }
+
+    items.push_back(std::move(element));
+    range.size += 1;
+}
+
+template<typename T>
+AstView<T> AstArena::items(AstRange<T> range)
+{
+    return AstView<T>(store<T>().data() + range.first, range.size);
+}
+
+template<typename T>
+AstView<const T> AstArena::items(AstRange<T> range) const
+{
+    return AstView<const T>(store<T>().data() + range.first, range.size);
+}
+
 /*
  * Stuff to print the AST
  */
 
-void print_ast(const Ast*, FILE* stream = stdout);
-void print_ast(const Ast*, StringBuffer&);
-
-void print_indent(const int, StringBuffer&);
-
-void print_statements(const Vector<Statement>&, StringBuffer&, const int indent = 0);
-void print_statement(const Statement&, StringBuffer&, const int indent = 0);
-void print_expression(const Expression&, StringBuffer&, const int indent = 0);
-
-void print(const Closure&, FILE* stream = stdout, const int indent = 0);
-void print(const Closure&, StringBuffer&, const int indent = 0);
-void print(const Dotted&, StringBuffer&, const int indent = 0);
-void print(const Identifier&, StringBuffer&, const int indent = 0);
-void print(const Indexed&, StringBuffer&, const int indent = 0);
-void print(const AstInt&, StringBuffer&, const int indent = 0);
-void print(const AstList&, StringBuffer&, const int indent = 0);
-void print(const AstMap&, StringBuffer&, const int indent = 0);
-void print(const AstNumber&, StringBuffer&, const int indent = 0);
-void print(const AstOperation&, StringBuffer&, const int indent = 0);
-void print(const AstString&, StringBuffer&, const int indent = 0);
-void print(const AstTable&, StringBuffer&, const int indent = 0);
-
-void print(const Assignment&, StringBuffer&, const int indent = 0);
-void print(const Call&, StringBuffer&, const int indent = 0);
-void print(const Condition&, StringBuffer&, const int indent = 0);
-void print(const ForLoop&, StringBuffer&, const int indent = 0);
-void print(const ForInLoop&, StringBuffer&, const int indent = 0);
-void print(const LocalDefinition&, StringBuffer&, const int indent = 0);
-void print(const Return&, StringBuffer&, const int indent = 0);
-void print(const TailCall&, StringBuffer&, const int indent = 0);
-void print(const WhileLoop&, StringBuffer&, const int indent = 0);
+/*
+ * Number of nodes of an AST. Identifiers on the left of assignments and arguments of
+ * closures count as expressions.
+ */
+struct AstCount
+{
+    size_t blocks      = 0;
+    size_t statements  = 0;
+    size_t expressions = 0;
+};
+
+AstCount count_nodes(const AstArena&);
+
+void print_ast(const AstArena&, FILE* stream = stdout);
+void print_ast(const AstArena&, StringBuffer&);
+
+void print_indent(StringBuffer&, const int indent);
+
+void print_statements(const AstArena&, AstView<const Statement>, StringBuffer&, const int indent = 0);
+void print_statement(const AstArena&, Statement, StringBuffer&, const int indent = 0);
+void print_expression(const AstArena&, Expression, StringBuffer&, const int indent = 0);
+
+void print(const AstArena&, const Closure&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Dotted&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Identifier&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Indexed&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstInt&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstList&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstMap&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstNumber&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstOperation&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstString&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const AstTable&, StringBuffer&, const int indent = 0);
+
+void print(const AstArena&, const Assignment&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Call&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Condition&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const ForLoop&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const ForInLoop&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const LocalDefinition&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const Return&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const TailCall&, StringBuffer&, const int indent = 0);
+void print(const AstArena&, const WhileLoop&, StringBuffer&, const int indent = 0);
 
 #endif  // LUA4DEC_AST_H
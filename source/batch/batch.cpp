@@ -0,0 +1,236 @@
+#include "batch/batch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+Vector<String> collect_files(const Vector<String>& inputs)
+{
+    Vector<String> files;
+
+    for(const auto& input : inputs)
+    {
+        std::error_code error;
+
+        if(!input.empty() && input[0] == '@')
+        {
+            std::ifstream list(input.substr(1));
+            String        line;
+            while(std::getline(list, line))
+            {
+                if(!line.empty() && line.back() == '\r')
+                    line.pop_back();
+
+                if(!line.empty())
+                    files.push_back(line);
+            }
+        }
+        else if(fs::is_directory(input, error))
+        {
+            // Directory order is unspecified, the files are sorted for a stable report.
+            Vector<String> directory;
+
+            // The iterator is advanced with an error code, a directory that changes while
+            // it is listed does not throw. Entries that cannot be read are skipped.
+            const auto options  = fs::directory_options::skip_permission_denied;
+            auto       iterator = fs::recursive_directory_iterator(input, options, error);
+            for(; !error && iterator != fs::recursive_directory_iterator();
+                iterator.increment(error))
+            {
+                std::error_code entry_error;
+                if(iterator->is_regular_file(entry_error) &&
+                   iterator->path().extension() != ".lua")
+                    directory.push_back(iterator->path().string());
+            }
+
+            if(error)
+            {
+                fprintf(
+                    stderr,
+                    "Could not list all of %s: %s\n",
+                    input.c_str(),
+                    error.message().c_str());
+            }
+
+            std::sort(directory.begin(), directory.end());
+            files.insert(files.end(), directory.begin(), directory.end());
+        }
+        else
+        {
+            files.push_back(input);
+        }
+    }
+
+    return files;
+}
+
+/*
+ * @brief   Everything the single file mode does, except printing to stdout.
+ */
+Error decompile_file(const char* filename, const BatchOptions& options, Metrics& metrics)
+{
+    if(options.measure || options.tracer || options.profile)
+    {
+        // The measured files are not taken from the cache, every phase runs.
+        const auto output = std::string(filename).append(".lua");
+        auto*      stream = fopen(output.c_str(), "w+");
+        if(stream == nullptr)
+            return Error{Status::FILE_NOT_WRITABLE, 0};
+
+        // Every file has a profile of its own, which is added to the one of the batch.
+        auto profile = options.profile ? std::make_unique<HandlerProfile>() : nullptr;
+        auto error   = decompile_measured(
+            filename, stream, metrics, options.memo, options.tracer, profile.get());
+        fclose(stream);
+
+        if(profile)
+            options.profile->merge(*profile);
+
+        if(error.status != Status::OK)
+            remove(output.c_str());
+
+        return error;
+    }
+
+    if(options.cache)
+    {
+        String text;
+        auto   error = decompile_cached(filename, *options.cache, text, options.memo);
+
+        if(error.status == Status::OK)
+            error.status = write_file(filename, text);
+
+        return error;
+    }
+
+    Chunk chunk;
+    auto  error = load_chunk(chunk, filename);
+    if(error.status != Status::OK)
+        return error;
+
+    error.status = stream_file(filename, chunk.main, options.memo);
+
+    return error;
+}
+
+/*
+ * @brief   decompile_file that fails only the file if an exception is thrown for it.
+ */
+static Error decompile_guarded(
+    const char*         filename,
+    const BatchOptions& options,
+    Metrics&            metrics)
+{
+    try
+    {
+        return decompile_file(filename, options, metrics);
+    }
+    catch(const std::bad_variant_access&)
+    {
+        return Error{Status::BAD_VARIANT, 0};
+    }
+    catch(const EmptyStack&)
+    {
+        return Error{Status::EMPTY_STACK, 0};
+    }
+    catch(...)
+    {
+        return Error{Status::UNDEFINED, 0};
+    }
+}
+
+Vector<BatchResult> decompile_batch(
+    const Vector<String>& files,
+    ThreadPool&           pool,
+    FILE*                 stream,
+    const BatchOptions&   options)
+{
+    Vector<BatchResult> results(files.size());
+    std::mutex          mutex;
+
+    for(size_t i = 0; i < files.size(); ++i)
+    {
+        pool.submit(
+            [&, i]
+            {
+                auto& result    = results[i];
+                result.filename = files[i];
+
+                std::error_code error;
+                const auto      bytes = fs::file_size(result.filename, error);
+
+                const auto start  = Clock::now();
+                const auto failed =
+                    decompile_guarded(result.filename.c_str(), options, result.metrics);
+                result.seconds    = std::chrono::duration<double>(Clock::now() - start).count();
+                result.status     = failed.status;
+                result.offset     = failed.offset;
+                result.bytes      = error ? 0 : size_t(bytes);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if(result.status == Status::OK)
+                {
+                    fprintf(
+                        stream,
+                        "OK      %s (%zu B, %.3f ms)\n",
+                        result.filename.c_str(),
+                        result.bytes,
+                        result.seconds * 1000);
+                }
+                else
+                {
+                    fprintf(
+                        stream,
+                        "FAILED  %s (%s at byte %zu)\n",
+                        result.filename.c_str(),
+                        STATUS_TO_STR.at(result.status).c_str(),
+                        result.offset);
+                }
+            });
+    }
+
+    pool.wait();
+
+    return results;
+}
+
+void print_summary(const Vector<BatchResult>& results, double seconds, FILE* stream)
+{
+    size_t failed = 0;
+    size_t bytes  = 0;
+    for(const auto& result : results)
+    {
+        if(result.status != Status::OK)
+            failed += 1;
+        else
+            bytes += result.bytes;
+    }
+
+    fprintf(
+        stream,
+        "Decompiled %zu of %zu files in %.3f s (%.1f files/s, %.2f MB/s).\n",
+        results.size() - failed,
+        results.size(),
+        seconds,
+        seconds > 0 ? results.size() / seconds : 0.0,
+        seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+}
+
+void print_memo_summary(const FunctionMemo& memo, FILE* stream)
+{
+    const auto hits    = memo.hits();
+    const auto lookups = hits + memo.misses();
+
+    fprintf(
+        stream,
+        "Reused %zu of %zu closures (%.1f %%).\n",
+        hits,
+        lookups,
+        lookups > 0 ? 100.0 * hits / lookups : 0.0);
+}
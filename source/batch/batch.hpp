@@ -0,0 +1,59 @@
+#ifndef LUA4DEC_BATCH_H
+#define LUA4DEC_BATCH_H
+
+#include "lua4dec.hpp"
+
+/*
+ * Outcome of decompiling one file of a batch.
+ */
+struct BatchResult
+{
+    String  filename;
+    Status  status  = Status::OK;
+    size_t  offset  = 0;  // of the byte at which loading failed
+    size_t  bytes   = 0;
+    double  seconds = 0;
+    Metrics metrics;  // only if the batch is measured
+};
+
+/*
+ * What a batch shares between its files. Results are taken from and kept in the cache,
+ * identical functions are parsed once with the memo. A measured batch records the
+ * metrics of every file, a traced batch also the spans of its phases and functions. The
+ * times of the handlers of all files are added up in the profile.
+ */
+struct BatchOptions
+{
+    ResultCache*    cache   = nullptr;
+    FunctionMemo*   memo    = nullptr;
+    Tracer*         tracer  = nullptr;
+    HandlerProfile* profile = nullptr;
+    bool            measure = false;
+};
+
+/*
+ * @brief   Expands the inputs into the files of a batch. A directory adds every file below
+ *          it except the .lua files, an input that starts with '@' names a list of files
+ *          (one per line), any other input is a file.
+ */
+Vector<String> collect_files(const Vector<String>& inputs);
+
+/*
+ * @brief   Decompiles the files on the pool, one file per task. The source of each file is
+ *          written next to it as <file>.lua and a status line is printed to 'stream' as
+ *          soon as the file is done.
+ */
+Vector<BatchResult> decompile_batch(
+    const Vector<String>& files,
+    ThreadPool&           pool,
+    FILE*                 stream,
+    const BatchOptions&   options = {});
+
+void print_summary(const Vector<BatchResult>& results, double seconds, FILE* stream);
+
+/*
+ * @brief   Prints how many closures were copied from the memo instead of being parsed.
+ */
+void print_memo_summary(const FunctionMemo& memo, FILE* stream);
+
+#endif  // LUA4DEC_BATCH_H
@@ -0,0 +1,240 @@
+#include "cache/cache.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static constexpr char ENTRY_EXTENSION[] = ".l4c";
+static constexpr char TEMP_EXTENSION[]  = ".tmp";
+
+/*
+ * Temporary files older than this are left over from a writer that did not finish.
+ */
+static constexpr auto TEMP_LIFETIME = std::chrono::hours(1);
+
+/*
+ * Front of an entry file, followed by 'text' bytes of text.
+ */
+struct EntryHeader
+{
+    char     magic[4] = {'L', '4', 'D', 'C'};
+    uint32_t status   = 0;
+    uint64_t key      = 0;
+    uint64_t size     = 0;
+    uint64_t offset   = 0;
+    uint64_t text     = 0;
+};
+
+/*
+ * @brief   A directory that cannot be created makes every store fail, which only leaves
+ *          the entries missing.
+ */
+ResultCache::ResultCache(String directory, uint64_t limit)
+    : m_directory(std::move(directory))
+    , m_limit(limit)
+{
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+}
+
+uint64_t ResultCache::key(const Byte* data, size_t size)
+{
+    const auto version = hash_bytes(CACHE_VERSION.data(), CACHE_VERSION.size());
+    return hash_bytes(data, size, version);
+}
+
+/*
+ * @brief   The key and the size of the input are compared, an entry of a colliding hash
+ *          is a miss. An entry whose text does not fit the file is damaged, it is a miss
+ *          and is removed. A hit makes the entry the most recently used one.
+ */
+bool ResultCache::load(uint64_t key, size_t size, CacheEntry& entry) const
+{
+    const auto filename = path(key);
+    auto*      stream   = fopen(filename.c_str(), "rb");
+
+    if(stream == nullptr)
+        return false;
+
+    EntryHeader header;
+    EntryHeader expected;
+
+    bool valid = fread(&header, sizeof(header), 1, stream) == 1 &&
+                 memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+                 header.key == key && header.size == size &&
+                 header.status <= static_cast<uint32_t>(Status::UNDEFINED);
+
+    // The text is only allocated once it is known to be in the file.
+    auto remaining = long(-1);
+    if(valid && fseek(stream, 0, SEEK_END) == 0)
+    {
+        remaining = ftell(stream) - long(sizeof(header));
+        if(fseek(stream, sizeof(header), SEEK_SET) != 0)
+            remaining = -1;
+    }
+
+    const bool damaged = valid && (remaining < 0 || header.text > uint64_t(remaining));
+
+    if(valid && !damaged)
+    {
+        entry.status = static_cast<Status>(header.status);
+        entry.offset = size_t(header.offset);
+        entry.text.resize(size_t(header.text));
+        valid = fread(entry.text.data(), 1, entry.text.size(), stream) == entry.text.size();
+    }
+
+    fclose(stream);
+
+    std::error_code error;
+
+    if(damaged)
+    {
+        fs::remove(filename, error);
+        return false;
+    }
+
+    if(valid)
+    {
+        fs::last_write_time(filename, fs::file_time_type::clock::now(), error);
+    }
+
+    return valid;
+}
+
+bool ResultCache::store(uint64_t key, size_t size, const CacheEntry& entry)
+{
+    static std::atomic<unsigned> counter = 0;
+
+    std::error_code error;
+
+    // Every writer has a file of its own, the name holds the process and a number that
+    // is unique in the process.
+    const auto filename  = path(key);
+    const auto temporary = filename + "." + std::to_string(getpid()) + "." +
+                           std::to_string(counter++) + TEMP_EXTENSION;
+
+    auto* stream = fopen(temporary.c_str(), "wb");
+    if(stream == nullptr)
+        return false;
+
+    EntryHeader header;
+    header.status = static_cast<uint32_t>(entry.status);
+    header.key    = key;
+    header.size   = size;
+    header.offset = entry.offset;
+    header.text   = entry.text.size();
+
+    bool written = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+                   fwrite(entry.text.data(), 1, entry.text.size(), stream) ==
+                       entry.text.size();
+    written      = fclose(stream) == 0 && written;
+
+    if(written)
+        fs::rename(temporary, filename, error);
+
+    if(!written || error)
+    {
+        fs::remove(temporary, error);
+        return false;
+    }
+
+    // The first store lists the directory to learn the size of the entries.
+    const auto stores = m_stores++;
+    const auto total  = m_size += sizeof(header) + entry.text.size();
+
+    if(stores % EVICT_INTERVAL == 0 || total > m_limit)
+        evict();
+
+    return true;
+}
+
+/*
+ * @brief   Other processes may evict at the same time, files that are already gone are
+ *          skipped.
+ */
+void ResultCache::evict()
+{
+    struct File
+    {
+        fs::path           path;
+        uint64_t           size;
+        fs::file_time_type time;
+    };
+
+    Vector<File>    files;
+    uint64_t        total = 0;
+    std::error_code error;
+    std::error_code listing;
+
+    const auto now = fs::file_time_type::clock::now();
+
+    // The iterator is advanced with an error code, a directory that changes while it is
+    // listed does not throw.
+    auto iterator = fs::directory_iterator(m_directory, listing);
+    for(; !listing && iterator != fs::directory_iterator(); iterator.increment(listing))
+    {
+        const auto& file      = *iterator;
+        const auto  extension = file.path().extension();
+        const auto  time      = file.last_write_time(error);
+        if(error)
+            continue;
+
+        if(extension == TEMP_EXTENSION && now - time > TEMP_LIFETIME)
+        {
+            fs::remove(file.path(), error);
+        }
+        else if(extension == ENTRY_EXTENSION)
+        {
+            const auto size = file.file_size(error);
+            if(error)
+                continue;
+
+            files.push_back({file.path(), size, time});
+            total += size;
+        }
+    }
+
+    m_size = total;
+
+    if(total <= m_limit)
+        return;
+
+    std::sort(
+        files.begin(),
+        files.end(),
+        [](const File& first, const File& second) { return first.time < second.time; });
+
+    for(const auto& file : files)
+    {
+        if(total <= m_limit)
+            break;
+
+        fs::remove(file.path, error);
+        total -= file.size;
+    }
+
+    m_size = total;
+}
+
+const String& ResultCache::directory() const
+{
+    return m_directory;
+}
+
+String ResultCache::path(uint64_t key) const
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+    return (fs::path(m_directory) / name).string() + ENTRY_EXTENSION;
+}
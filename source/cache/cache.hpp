@@ -0,0 +1,74 @@
+#ifndef LUA4DEC_CACHE_H
+#define LUA4DEC_CACHE_H
+
+#include "lua/lua.hpp"
+
+#include <atomic>
+
+/*
+ * Version of the decompiled output. It is part of every cache key and has to be changed
+ * whenever the same bytecode can decompile to a different text, older entries are not
+ * used afterwards.
+ */
+constexpr StringView CACHE_VERSION = "lua4dec-1";
+
+/*
+ * Decompiled text and status of one input.
+ */
+struct CacheEntry
+{
+    Status status = Status::OK;
+    size_t offset = 0;  // of the byte at which loading failed
+    String text;
+};
+
+/*
+ * Results of earlier decompilations on disk, one file per input in a directory that can be
+ * shared by several processes. An entry is written to a temporary file and renamed, so a
+ * reader sees either no entry or a whole one. The least recently used entries are removed
+ * once the entries take more than 'limit' bytes. Stores keep an estimate of that size, the
+ * directory is only listed when the estimate exceeds the limit or after EVICT_INTERVAL
+ * stores, which also catch up with the entries of other processes.
+ */
+class ResultCache
+{
+public:
+    static constexpr uint64_t DEFAULT_LIMIT  = uint64_t(256) << 20;
+    static constexpr unsigned EVICT_INTERVAL = 256;
+
+    explicit ResultCache(String directory, uint64_t limit = DEFAULT_LIMIT);
+
+    /*
+     * @brief   Key of the input bytes for the current CACHE_VERSION.
+     */
+    static uint64_t key(const Byte* data, size_t size);
+
+    /*
+     * @brief   Fills 'entry' if the input with 'key' and 'size' bytes was stored before.
+     */
+    bool load(uint64_t key, size_t size, CacheEntry& entry) const;
+
+    /*
+     * @brief   Stores the entry of an input and evicts old entries when needed. A cache that
+     *          cannot be written is not an error, the entry is only missing then.
+     */
+    bool store(uint64_t key, size_t size, const CacheEntry& entry);
+
+    /*
+     * @brief   Removes the least recently used entries until they take at most 'limit'
+     *          bytes, and temporary files that were left behind by a crashed writer.
+     */
+    void evict();
+
+    const String& directory() const;
+
+private:
+    String path(uint64_t key) const;
+
+    String                m_directory;
+    uint64_t              m_limit;
+    std::atomic<uint64_t> m_size{0};  // estimated bytes of the entries
+    std::atomic<unsigned> m_stores{0};
+};
+
+#endif  // LUA4DEC_CACHE_H
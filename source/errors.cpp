@@ -1,12 +1,18 @@
 #include "errors.hpp"
 
 // clang-format off
-std::unordered_map<Status, std::string> STATUS_TO_STR = {
+const std::unordered_map<Status, std::string> STATUS_TO_STR = {
     {Status::OK,                      "NONE"},
     {Status::SIGNATURE_MISMATCH,      "SIGNATURE_MISMATCH"},
+    {Status::ARCHITECTURE_MISMATCH,   "ARCHITECTURE_MISMATCH"},
     {Status::FUNCTION_PARAM_MISMATCH, "FUNCTION_PARAM_MISMATCH"},
     {Status::EMPTY_STACK,             "EMPTY_STACK"},
     {Status::BAD_VARIANT,             "BAD_VARIANT"},
+    {Status::FILE_NOT_READABLE,       "FILE_NOT_READABLE"},
+    {Status::FILE_NOT_WRITABLE,       "FILE_NOT_WRITABLE"},
+    {Status::UNEXPECTED_END,          "UNEXPECTED_END"},
+    {Status::MALFORMED_CHUNK,         "MALFORMED_CHUNK"},
+    {Status::FUNCTION_NOT_FOUND,      "FUNCTION_NOT_FOUND"},
     {Status::UNDEFINED,               "UNDEFINED"},
 };
 // clang-format on
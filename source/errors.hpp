@@ -17,11 +17,23 @@ enum class Status : unsigned
     FUNCTION_PARAM_MISMATCH,
     EMPTY_STACK,
     BAD_VARIANT,
+    FILE_NOT_READABLE,
+    FILE_NOT_WRITABLE,
+    UNEXPECTED_END,
+    MALFORMED_CHUNK,
+    FUNCTION_NOT_FOUND,
     UNDEFINED,
 };
 
-extern std::unordered_map<Status, std::string> STATUS_TO_STR;
+/*
+ * A status and the offset of the input byte at which it occurred.
+ */
+struct Error
+{
+    Status status = Status::OK;
+    size_t offset = 0;
+};
 
-void quit_on(const bool condition, const Status status, const char* message);
+extern const std::unordered_map<Status, std::string> STATUS_TO_STR;
 
 #endif  // LUA4DEC_ERRORS_H
@@ -0,0 +1,252 @@
+#include "io/io.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <utility>
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+#ifdef _WIN32
+        std::swap(m_file, other.m_file);
+        std::swap(m_mapping, other.m_mapping);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    HANDLE file = CreateFileA(
+        filename,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_data    = static_cast<const Byte*>(view);
+    m_size    = static_cast<size_t>(size.QuadPart);
+    m_file    = file;
+    m_mapping = mapping;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file)
+        CloseHandle(m_file);
+
+    m_data    = nullptr;
+    m_size    = 0;
+    m_file    = nullptr;
+    m_mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    const auto size = static_cast<size_t>(info.st_size);
+    void*      view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+
+    if(view == MAP_FAILED)
+        return false;
+
+    // The loader walks the chunk front to back exactly once.
+    madvise(view, size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const Byte*>(view);
+    m_size = size;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        munmap(const_cast<Byte*>(m_data), m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#endif
+
+const Byte* MappedFile::data() const
+{
+    return m_data;
+}
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
+
+bool MappedFile::is_open() const
+{
+    return m_data != nullptr;
+}
+
+StringBuffer::StringBuffer()
+{
+    m_buffer.reserve(CAPACITY);
+}
+
+StringBuffer::StringBuffer(FILE* stream)
+    : m_stream(stream)
+{
+    m_buffer.reserve(CAPACITY);
+}
+
+StringBuffer::~StringBuffer()
+{
+    flush();
+}
+
+StringBuffer& StringBuffer::operator<<(int value)
+{
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+
+    return *this << StringView(digits, result.ptr - digits);
+}
+
+/*
+ * @brief   Shortest of fixed and scientific notation with 6 significant digits, the same
+ *          as printf("%g") and the default of iostreams.
+ */
+StringBuffer& StringBuffer::operator<<(Number value)
+{
+    char digits[32];
+    auto result = std::to_chars(
+        digits,
+        digits + sizeof(digits),
+        value,
+        std::chars_format::general,
+        6);
+
+    return *this << StringView(digits, result.ptr - digits);
+}
+
+void StringBuffer::spaces(size_t count)
+{
+    static const String SPACES(256, ' ');
+
+    while(count > 0)
+    {
+        const auto n = std::min(count, SPACES.size());
+        *this << StringView(SPACES.data(), n);
+        count -= n;
+    }
+}
+
+/*
+ * @brief   Writes the buffered text to the stream, if there is one. The text is written
+ *          as it is, it is not a format string.
+ */
+void StringBuffer::flush()
+{
+    if(m_stream == nullptr)
+        return;
+
+    if(!m_buffer.empty())
+        fwrite(m_buffer.data(), 1, m_buffer.size(), m_stream);
+
+    m_buffer.clear();
+}
+
+String StringBuffer::str() const
+{
+    return m_buffer;
+}
+
+StringView StringBuffer::view() const
+{
+    return m_buffer;
+}
+
+void StringBuffer::clear()
+{
+    m_buffer.clear();
+}
+
+size_t StringBuffer::size() const
+{
+    return m_buffer.size();
+}
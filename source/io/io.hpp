@@ -0,0 +1,101 @@
+#ifndef LUA4DEC_IO_H
+#define LUA4DEC_IO_H
+
+#include "lua/lua.hpp"
+
+/*
+ * Read-only memory mapping of a whole file. The bytes are valid as long as the mapping
+ * exists. A mapping can be moved but not copied.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile&&) noexcept;
+    MappedFile& operator=(MappedFile&&) noexcept;
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const char* filename);
+    void close();
+
+    const Byte* data() const;
+    size_t      size() const;
+    bool        is_open() const;
+
+private:
+    const Byte* m_data = nullptr;
+    size_t      m_size = 0;
+
+#ifdef _WIN32
+    void* m_file    = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+/*
+ * Output of the printer. Text is appended to a buffer that is allocated once. With a
+ * stream attached, the buffer is written to the stream whenever it is full and when it
+ * is flushed or destroyed. Without a stream it collects the whole text.
+ * Integers are written like printf("%d") and numbers like printf("%g").
+ */
+class StringBuffer
+{
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    StringBuffer();
+    explicit StringBuffer(FILE* stream);
+    StringBuffer(const StringBuffer&)            = delete;
+    StringBuffer& operator=(const StringBuffer&) = delete;
+    ~StringBuffer();
+
+    StringBuffer& operator<<(StringView text)
+    {
+        if(m_stream && m_buffer.size() + text.size() > CAPACITY)
+            flush();
+
+        m_buffer.append(text.data(), text.size());
+        return *this;
+    }
+
+    StringBuffer& operator<<(const char* text)
+    {
+        return *this << StringView(text);
+    }
+
+    StringBuffer& operator<<(const String& text)
+    {
+        return *this << StringView(text);
+    }
+
+    StringBuffer& operator<<(char c)
+    {
+        return *this << StringView(&c, 1);
+    }
+
+    StringBuffer& operator<<(int value);
+    StringBuffer& operator<<(Number value);
+
+    /*
+     * @brief   Appends 'count' spaces without building a string of them.
+     */
+    void spaces(size_t count);
+
+    void       flush();
+    String     str() const;
+    StringView view() const;
+    size_t     size() const;
+
+    /*
+     * @brief   Drops the text that was not flushed and keeps the memory for the next one.
+     */
+    void clear();
+
+private:
+    String m_buffer;
+    FILE*  m_stream = nullptr;
+};
+
+#endif  // LUA4DEC_IO_H
@@ -1,132 +1,822 @@
 #include "errors.hpp"
 #include "lua/lua.hpp"
 
-String read_string(ByteIterator& iter)
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+StringView StringPool::store(String&& str)
 {
-    auto len = read<SizeT>(iter);
-    auto str = String(iter, iter + len - 1);  // minus zero
-    iter += len;
-    return str;
+    return m_strings.emplace_back(std::move(str));
 }
 
-String normalize(String&& str)
+/*
+ * @brief   Only a string that has to be changed is copied into the pool.
+ */
+StringView normalize(StringView str, StringPool& pool)
 {
     auto pos = str.find('\n');
-    if(pos != std::string::npos)
+    if(pos != StringView::npos)
     {
-        str[pos] = ' ';
+        auto copy = String(str);
+        copy[pos] = ' ';
+        return pool.store(std::move(copy));
     }
     return str;
 }
 
-ChunkHeader read_header(ByteIterator& iter)
+Status read_header(Cursor& cursor, ChunkHeader& header)
 {
-    ChunkHeader header;
+    // Signature and the sizes, the test number is checked once its size is known.
+    if(!cursor.has(13))
+        return Status::UNEXPECTED_END;
 
     // Read signature
     bool signature_ok = true;
-    signature_ok &= read<Byte>(iter) == 0x1B;  // . (ESC)
-    signature_ok &= read<Byte>(iter) == 0x4C;  // L
-    signature_ok &= read<Byte>(iter) == 0x75;  // u
-    signature_ok &= read<Byte>(iter) == 0x61;  // a
-    signature_ok &= read<Byte>(iter) == 0x40;  // @ (4.0)
+    signature_ok &= cursor.read<Byte>() == 0x1B;  // . (ESC)
+    signature_ok &= cursor.read<Byte>() == 0x4C;  // L
+    signature_ok &= cursor.read<Byte>() == 0x75;  // u
+    signature_ok &= cursor.read<Byte>() == 0x61;  // a
+    signature_ok &= cursor.read<Byte>() == 0x40;  // @ (4.0)
 
-    quit_on(!signature_ok, Status::SIGNATURE_MISMATCH, "Header mismatch! '.Lua@' not found");
+    if(!signature_ok)
+    {
+        cursor.seek(cursor.offset() - 5);
+        return Status::SIGNATURE_MISMATCH;
+    }
 
     // Read size of types, registers, and the test number
-    header.is_little_endian      = read<Byte>(iter) == 0x01;
-    header.bytes_for_int         = read<Byte>(iter);
-    header.bytes_for_size_t      = read<Byte>(iter);
-    header.bytes_for_instruction = read<Byte>(iter);
-    header.bits_for_instruction  = read<Byte>(iter);
-    header.bits_for_operator     = read<Byte>(iter);
-    header.bits_for_register_b   = read<Byte>(iter);
-    header.bytes_for_test_number = read<Byte>(iter);
-    header.test_number           = read<Number>(iter);
-
+    header.is_little_endian      = cursor.read<Byte>() == 0x01;
+    header.bytes_for_int         = cursor.read<Byte>();
+    header.bytes_for_size_t      = cursor.read<Byte>();
+    header.bytes_for_instruction = cursor.read<Byte>();
+    header.bits_for_instruction  = cursor.read<Byte>();
+    header.bits_for_operator     = cursor.read<Byte>();
+    header.bits_for_register_b   = cursor.read<Byte>();
+    header.bytes_for_test_number = cursor.read<Byte>();
+
+    // The size of size_t and of numbers select the layout of the rest of the chunk.
     bool architecture_ok = true;
     architecture_ok &= header.bytes_for_int == sizeof(Int);
-    architecture_ok &= header.bytes_for_size_t == sizeof(SizeT);
+    architecture_ok &= header.bytes_for_size_t == 4 || header.bytes_for_size_t == 8;
     architecture_ok &= header.bytes_for_instruction == BITS_I / 8;
     architecture_ok &= header.bits_for_instruction == BITS_I;
     architecture_ok &= header.bits_for_operator == BITS_OP;
-    architecture_ok &= header.bits_for_register_b == BITS_B;
-    architecture_ok &= header.bytes_for_test_number == sizeof(Number);
-    architecture_ok &= (LUA_NUMBER - header.test_number) < 0.0000001;
+    architecture_ok &= header.bits_for_register_b > 0;
+    architecture_ok &= header.bits_for_register_b < BITS_I - BITS_OP;
+    architecture_ok &=
+        header.bytes_for_test_number == sizeof(float) ||
+        header.bytes_for_test_number == sizeof(double);
+
+    if(!architecture_ok)
+        return Status::ARCHITECTURE_MISMATCH;
+
+    if(!cursor.has(header.bytes_for_test_number))
+        return Status::UNEXPECTED_END;
+
+    // The test number has to be compared in the precision and byte order of the chunk.
+    const bool swap = header.is_little_endian != HOST_IS_LITTLE_ENDIAN;
+    if(header.bytes_for_test_number == sizeof(float))
+    {
+        auto test_number = cursor.read<float>();
+        test_number      = swap ? swap_bytes(test_number) : test_number;
+        architecture_ok &= std::abs(float(LUA_NUMBER) - test_number) < 0.0000001;
+        header.test_number = test_number;
+    }
+    else
+    {
+        auto test_number = cursor.read<double>();
+        test_number      = swap ? swap_bytes(test_number) : test_number;
+        architecture_ok &= std::abs(double(LUA_NUMBER) - test_number) < 0.0000001;
+        header.test_number = test_number;
+    }
 
-    quit_on(
-        !architecture_ok,
-        Status::ARCHITECTURE_MISMATCH,
-        "Architecture mismatch! (32 bit <-> 64 bit)");
+    if(!architecture_ok)
+        return Status::ARCHITECTURE_MISMATCH;
 
-    return header;
+    return Status::OK;
 }
 
-Function read_function(ByteIterator& iter)
+/*
+ * @brief   Reads the number of elements of a section and checks once that the rest of
+ *          the input can hold that many elements of at least 'element_size' bytes. On
+ *          error the cursor points at the count.
+ */
+template<typename Layout>
+Status read_count(Cursor& cursor, size_t element_size, int& count)
 {
-    Function function;
+    if(!cursor.has(sizeof(Int)))
+        return Status::UNEXPECTED_END;
+
+    const auto offset = cursor.offset();
+
+    count = cursor.read_value<Layout, int>();
+
+    if(count < 0)
+    {
+        cursor.seek(offset);
+        return Status::MALFORMED_CHUNK;
+    }
+
+    if(cursor.remaining() / element_size < size_t(count))
+    {
+        cursor.seek(offset);
+        return Status::UNEXPECTED_END;
+    }
+
+    return Status::OK;
+}
 
-    function.name             = read_string(iter);
-    function.line_defined     = read<int>(iter);
-    function.number_of_params = read<int>(iter);
-    function.is_variadic      = read<Byte>(iter) == 0x01;
-    function.max_stack_size   = read<int>(iter);
+/*
+ * @brief   Every constant, number and nested function that an instruction refers to has
+ *          to exist, so that the parser can index them without checks. Counts of stack
+ *          elements have to fit the operator and the stack of the function. Returns the
+ *          index of the first instruction that does not.
+ */
+static size_t check_operands(const Function& function)
+{
+    const auto& code = function.code;
 
-    auto num_locals = read<int>(iter);
-    for(int i = 0; i < num_locals; i++)
+    for(size_t i = 0; i < code.size(); ++i)
+    {
+        switch(code.op[i])
+        {
+        case Operator::PUSHSTRING:
+        case Operator::GETGLOBAL:
+        case Operator::GETDOTTED:
+        case Operator::PUSHSELF:
+        case Operator::SETGLOBAL:
+            if(code.u[i] >= function.globals.size())
+                return i;
+            break;
+        case Operator::PUSHNUM:
+        case Operator::PUSHNEGNUM:
+            if(code.u[i] >= function.numbers.size())
+                return i;
+            break;
+        case Operator::CLOSURE:
+            if(code.a[i] >= function.functions.size())
+                return i;
+            break;
+        case Operator::SETTABLE:
+            // At least the assigned value is taken from the stack.
+            if(code.b[i] == 0)
+                return i;
+            break;
+        case Operator::PUSHNIL:
+            if(code.u[i] > function.max_stack_size)
+                return i;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return code.size();
+}
+
+/*
+ * Smallest sizes of the elements of each section.
+ */
+template<typename Layout>
+struct SectionSize
+{
+    using SizeT = typename Layout::SizeT;
+
+    static constexpr size_t LOCAL    = sizeof(SizeT) + 2 * sizeof(Int);
+    static constexpr size_t STRING   = sizeof(SizeT);
+    static constexpr size_t FUNCTION = sizeof(SizeT) + 9 * sizeof(Int) + 1;
+};
+
+template<typename Layout>
+Status read_function(
+    Cursor&            cursor,
+    StringPool&        pool,
+    const ChunkHeader& header,
+    Function&          function,
+    unsigned           depth)
+{
+    using Number = typename Layout::Number;
+
+    constexpr size_t LOCAL_SIZE    = SectionSize<Layout>::LOCAL;
+    constexpr size_t STRING_SIZE   = SectionSize<Layout>::STRING;
+    constexpr size_t FUNCTION_SIZE = SectionSize<Layout>::FUNCTION;
+
+    int  count = 0;
+    auto error = cursor.read_string<Layout>(function.name);
+    if(error != Status::OK)
+        return error;
+
+    if(!cursor.has(3 * sizeof(Int) + 1))
+        return Status::UNEXPECTED_END;
+
+    function.line_defined     = cursor.read_value<Layout, int>();
+    function.number_of_params = cursor.read_value<Layout, int>();
+    function.is_variadic      = cursor.read<Byte>() == 0x01;
+    function.max_stack_size   = cursor.read_value<Layout, int>();
+
+    // Locals
+    if((error = read_count<Layout>(cursor, LOCAL_SIZE, count)) != Status::OK)
+        return error;
+
+    function.locals.reserve(count);
+    for(int i = 0; i < count; i++)
     {
         Local local;
-        local.name     = read_string(iter);
-        local.start_pc = read<int>(iter);
-        local.end_pc   = read<int>(iter);
+        if((error = cursor.read_string<Layout>(local.name)) != Status::OK)
+            return error;
+
+        if(!cursor.has(2 * sizeof(Int)))
+            return Status::UNEXPECTED_END;
+
+        local.start_pc = cursor.read_value<Layout, int>();
+        local.end_pc   = cursor.read_value<Layout, int>();
         function.locals.emplace_back(local);
     }
 
-    auto num_lineinfo = read<int>(iter);
-    for(int i = 0; i < num_lineinfo; i++)
+    // Line info
+    if((error = read_count<Layout>(cursor, sizeof(Int), count)) != Status::OK)
+        return error;
+
+    static_assert(sizeof(unsigned) == sizeof(Int));
+    function.lines.resize(count);
+    cursor.read_array<Layout>(function.lines.data(), count);
+
+    // Strings
+    if((error = read_count<Layout>(cursor, STRING_SIZE, count)) != Status::OK)
+        return error;
+
+    function.globals.reserve(count);
+    for(int i = 0; i < count; i++)
+    {
+        StringView global;
+        if((error = cursor.read_string<Layout>(global)) != Status::OK)
+            return error;
+
+        function.globals.emplace_back(normalize(global, pool));
+    }
+
+    // Numbers
+    if((error = read_count<Layout>(cursor, sizeof(Number), count)) != Status::OK)
+        return error;
+
+    function.numbers.resize(count);
+    if constexpr(std::is_same_v<Number, ::Number>)
+    {
+        cursor.read_array<Layout>(function.numbers.data(), count);
+    }
+    else
+    {
+        for(auto& number : function.numbers)
+            number = cursor.read_value<Layout, Number>();
+    }
+
+    // Nested functions
+    if((error = read_count<Layout>(cursor, FUNCTION_SIZE, count)) != Status::OK)
+        return error;
+
+    if(count > 0 && depth >= MAX_NESTING)
+        return Status::MALFORMED_CHUNK;
+
+    function.functions.resize(count);
+    for(auto& nested : function.functions)
+    {
+        error = read_function<Layout>(cursor, pool, header, nested, depth + 1);
+        if(error != Status::OK)
+            return error;
+    }
+
+    // Instructions
+    if((error = read_count<Layout>(cursor, sizeof(Instruction), count)) != Status::OK)
+        return error;
+
+    const auto instructions = cursor.offset();
+    const auto bytes        = cursor.position();
+    cursor.skip(count * sizeof(Instruction));
+
+    // Instructions that need no changes are used straight from the input if they are
+    // aligned. Otherwise they are copied in one block.
+    const bool is_aligned = reinterpret_cast<uintptr_t>(bytes) % alignof(Instruction) == 0;
+    if(!Layout::swap && header.bits_for_register_b == BITS_B && is_aligned)
+        function.instructions.borrow(reinterpret_cast<const Instruction*>(bytes), count);
+    else
+        function.instructions.copy(bytes, count);
+
+    // The instructions are swapped at once instead of one at a time.
+    if constexpr(Layout::swap)
+        swap_byte_order(function.instructions.mutable_data(), count);
+
+    if(header.bits_for_register_b != BITS_B)
+    {
+        auto* data = function.instructions.mutable_data();
+        error      = convert_register_b(data, count, header.bits_for_register_b);
+        if(error != Status::OK)
+        {
+            cursor.seek(instructions);
+            return error;
+        }
+    }
+
+    function.code = decode(function.instructions.data(), count);
+
+    const auto invalid = check_operands(function);
+    if(invalid < function.code.size())
+    {
+        cursor.seek(instructions + invalid * sizeof(Instruction));
+        return Status::MALFORMED_CHUNK;
+    }
+
+    return Status::OK;
+}
+
+template<typename SizeT, typename Number>
+Status read_function(
+    Cursor&            cursor,
+    StringPool&        pool,
+    const ChunkHeader& header,
+    Function&          function)
+{
+    using Little = Layout<SizeT, Number, false>;
+    using Big    = Layout<SizeT, Number, true>;
+
+    if(header.is_little_endian == HOST_IS_LITTLE_ENDIAN)
+        return read_function<Little>(cursor, pool, header, function, 0);
+    else
+        return read_function<Big>(cursor, pool, header, function, 0);
+}
+
+Status read_function(
+    Cursor&            cursor,
+    StringPool&        pool,
+    const ChunkHeader& header,
+    Function&          function)
+{
+    const bool size_32   = header.bytes_for_size_t == 4;
+    const bool number_32 = header.bytes_for_test_number == sizeof(float);
+
+    if(size_32 && number_32)
+        return read_function<uint32_t, float>(cursor, pool, header, function);
+    else if(size_32)
+        return read_function<uint32_t, double>(cursor, pool, header, function);
+    else if(number_32)
+        return read_function<uint64_t, float>(cursor, pool, header, function);
+    else
+        return read_function<uint64_t, double>(cursor, pool, header, function);
+}
+
+/*
+ * @brief   Records the function at the cursor and the functions it contains and moves the
+ *          cursor behind them. Only the counts and the string lengths are read, the rest
+ *          of each section is skipped. Nothing is decoded or checked beyond the bounds.
+ */
+template<typename Layout>
+Status index_function(
+    Cursor&                cursor,
+    Vector<FunctionEntry>& functions,
+    size_t                 parent,
+    unsigned               depth)
+{
+    using Number = typename Layout::Number;
+
+    constexpr size_t LOCAL_SIZE    = SectionSize<Layout>::LOCAL;
+    constexpr size_t STRING_SIZE   = SectionSize<Layout>::STRING;
+    constexpr size_t FUNCTION_SIZE = SectionSize<Layout>::FUNCTION;
+
+    // The entry is stored before the nested functions are, so it is addressed by number.
+    const auto number = functions.size();
+
+    FunctionEntry entry;
+    entry.offset = cursor.offset();
+    entry.parent = parent;
+    entry.depth  = depth;
+
+    int  count = 0;
+    auto error = cursor.read_string<Layout>(entry.name);
+    if(error != Status::OK)
+        return error;
+
+    if(!cursor.has(3 * sizeof(Int) + 1))
+        return Status::UNEXPECTED_END;
+
+    entry.line_defined     = cursor.read_value<Layout, int>();
+    entry.number_of_params = cursor.read_value<Layout, int>();
+    cursor.skip(1 + sizeof(Int));  // variadic and stack size
+
+    // Locals
+    if((error = read_count<Layout>(cursor, LOCAL_SIZE, count)) != Status::OK)
+        return error;
+
+    for(int i = 0; i < count; i++)
+    {
+        StringView name;
+        if((error = cursor.read_string<Layout>(name)) != Status::OK)
+            return error;
+
+        if(!cursor.has(2 * sizeof(Int)))
+            return Status::UNEXPECTED_END;
+
+        cursor.skip(2 * sizeof(Int));
+    }
+
+    // Line info
+    if((error = read_count<Layout>(cursor, sizeof(Int), count)) != Status::OK)
+        return error;
+
+    cursor.skip(count * sizeof(Int));
+
+    // Strings
+    if((error = read_count<Layout>(cursor, STRING_SIZE, count)) != Status::OK)
+        return error;
+
+    entry.num_globals = count;
+    for(int i = 0; i < count; i++)
+    {
+        StringView global;
+        if((error = cursor.read_string<Layout>(global)) != Status::OK)
+            return error;
+    }
+
+    // Numbers
+    if((error = read_count<Layout>(cursor, sizeof(Number), count)) != Status::OK)
+        return error;
+
+    cursor.skip(count * sizeof(Number));
+
+    // Nested functions
+    if((error = read_count<Layout>(cursor, FUNCTION_SIZE, count)) != Status::OK)
+        return error;
+
+    if(count > 0 && depth >= MAX_NESTING)
+        return Status::MALFORMED_CHUNK;
+
+    entry.num_functions = count;
+    functions.push_back(entry);
+
+    for(int i = 0; i < count; i++)
+    {
+        error = index_function<Layout>(cursor, functions, number, depth + 1);
+        if(error != Status::OK)
+            return error;
+    }
+
+    // Instructions
+    if((error = read_count<Layout>(cursor, sizeof(Instruction), count)) != Status::OK)
+        return error;
+
+    functions[number].num_instructions = count;
+    cursor.skip(count * sizeof(Instruction));
+
+    return Status::OK;
+}
+
+template<typename SizeT, typename Number>
+Status index_function(
+    Cursor&                cursor,
+    const ChunkHeader&     header,
+    Vector<FunctionEntry>& functions)
+{
+    using Little = Layout<SizeT, Number, false>;
+    using Big    = Layout<SizeT, Number, true>;
+
+    if(header.is_little_endian == HOST_IS_LITTLE_ENDIAN)
+        return index_function<Little>(cursor, functions, 0, 0);
+    else
+        return index_function<Big>(cursor, functions, 0, 0);
+}
+
+Status index_function(
+    Cursor&                cursor,
+    const ChunkHeader&     header,
+    Vector<FunctionEntry>& functions)
+{
+    const bool size_32   = header.bytes_for_size_t == 4;
+    const bool number_32 = header.bytes_for_test_number == sizeof(float);
+
+    if(size_32 && number_32)
+        return index_function<uint32_t, float>(cursor, header, functions);
+    else if(size_32)
+        return index_function<uint32_t, double>(cursor, header, functions);
+    else if(number_32)
+        return index_function<uint64_t, float>(cursor, header, functions);
+    else
+        return index_function<uint64_t, double>(cursor, header, functions);
+}
+
+/*
+ * @brief   Nothing is printed and nothing exits on malformed input. The error tells what
+ *          went wrong and at which byte. The chunk is only complete if the status is OK.
+ */
+Error read_chunk(const Byte* data, size_t size, Chunk& chunk)
+{
+    auto cursor = Cursor(data, size);
+
+    chunk.strings = std::make_shared<StringPool>();
+
+    auto status = read_header(cursor, chunk.header);
+    if(status == Status::OK)
+        status = read_function(cursor, *chunk.strings, chunk.header, chunk.main);
+
+    return Error{status, cursor.offset()};
+}
+
+/*
+ * @brief   Scans the whole chunk once and records where each function starts. The index
+ *          is only complete if the status is OK.
+ */
+Error index_chunk(const Byte* data, size_t size, ChunkIndex& index)
+{
+    auto cursor = Cursor(data, size);
+
+    index.data = data;
+    index.size = size;
+    index.functions.clear();
+
+    auto status = read_header(cursor, index.header);
+    if(status == Status::OK)
+        status = index_function(cursor, index.header, index.functions);
+
+    return Error{status, cursor.offset()};
+}
+
+/*
+ * @brief   Loads the function 'number' of the index, and the functions it contains, as the
+ *          main function of the chunk. The offset of an error refers to the whole input.
+ */
+Error read_function_at(const ChunkIndex& index, size_t number, Chunk& chunk)
+{
+    if(number >= index.functions.size())
+        return Error{Status::FUNCTION_NOT_FOUND, 0};
+
+    auto cursor = Cursor(index.data, index.size);
+    cursor.seek(index.functions[number].offset);
+
+    chunk.header  = index.header;
+    chunk.buffer  = index.buffer;
+    chunk.strings = std::make_shared<StringPool>();
+
+    auto status = read_function(cursor, *chunk.strings, chunk.header, chunk.main);
+
+    return Error{status, cursor.offset()};
+}
+
+/*
+ * @brief   Decodes every argument of every instruction once, so that the parser and
+ *          later passes never have to shift and mask an instruction again.
+ */
+Code decode(const Instruction* instructions, size_t size)
+{
+    Code code;
+    code.op.resize(size);
+    code.a.resize(size);
+    code.b.resize(size);
+    code.u.resize(size);
+    code.s.resize(size);
+
+    // Writing through local pointers lets the compiler vectorize the loop. Stores to the
+    // byte sized operator column could alias the vectors otherwise.
+    const auto* in = instructions;
+    auto*       op = code.op.data();
+    auto*       a  = code.a.data();
+    auto*       b  = code.b.data();
+    auto*       u  = code.u.data();
+    auto*       s  = code.s.data();
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        const auto instruction = in[i];
+
+        op[i] = OP(instruction);
+        a[i]  = A(instruction);
+        b[i]  = uint16_t(B(instruction));
+        u[i]  = U(instruction);
+        s[i]  = S(instruction);
+    }
+
+    return code;
+}
+
+/*
+ * @brief   Only the operators with A and B arguments depend on the width of register B.
+ *          They are encoded again with the default width so that the parser can decode
+ *          every chunk with the constant A() and B() decoders.
+ */
+Status convert_register_b(Instruction* instructions, size_t size, Byte bits_for_register_b)
+{
+    const Instruction mask_b = (Instruction(1) << bits_for_register_b) - 1;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        auto& instruction = instructions[i];
+
+        switch(OP(instruction))
+        {
+        case Operator::CALL:
+        case Operator::TAILCALL:
+        case Operator::SETTABLE:
+        case Operator::SETLIST:
+        case Operator::CLOSURE:
+        {
+            const auto a = instruction >> (BITS_OP + bits_for_register_b);
+            const auto b = (instruction >> BITS_OP) & mask_b;
+
+            // The register value does not fit into the default register size.
+            if(a >= (1u << BITS_A) || b >= (1u << BITS_B))
+                return Status::ARCHITECTURE_MISMATCH;
+
+            const auto op = Instruction(OP(instruction));
+
+            instruction = op | (b << BIT_SHIFT_B) | (a << BIT_SHIFT_A);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return Status::OK;
+}
+
+/*
+ * @brief   Reverses the byte order of every instruction. Four instructions are swapped at
+ *          once with SSE2/SSSE3 or NEON; the remainder is swapped one at a time.
+ */
+void swap_byte_order(Instruction* instructions, size_t size)
+{
+    size_t i = 0;
+
+#if defined(__SSSE3__)
+    const __m128i order =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for(; i + 4 <= size; i += 4)
+    {
+        auto* block = reinterpret_cast<__m128i*>(instructions + i);
+        _mm_storeu_si128(block, _mm_shuffle_epi8(_mm_loadu_si128(block), order));
+    }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    for(; i + 4 <= size; i += 4)
     {
-        function.lines.emplace_back(read<int>(iter));
+        auto*   block = reinterpret_cast<__m128i*>(instructions + i);
+        __m128i words = _mm_loadu_si128(block);
+
+        // Swap the 16 bit halves of each word, then the bytes of each half.
+        words = _mm_shufflelo_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+        words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(2, 3, 0, 1));
+        words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+
+        _mm_storeu_si128(block, words);
     }
+#elif defined(__ARM_NEON)
+    for(; i + 4 <= size; i += 4)
+    {
+        auto* block = reinterpret_cast<uint8_t*>(instructions + i);
+        vst1q_u8(block, vrev32q_u8(vld1q_u8(block)));
+    }
+#endif
 
-    auto num_constants = read<int>(iter);
-    for(int i = 0; i < num_constants; i++)
+    for(; i < size; ++i)
     {
-        function.globals.emplace_back(normalize(read_string(iter)));
+        instructions[i] = swap_bytes(instructions[i]);
     }
+}
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/*
+ * @brief   Mixes one 8 byte word at a time into the hash, with the round and the
+ *          avalanche of xxHash64 (but only one lane).
+ */
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
 
-    auto num_numbers = read<int>(iter);
-    for(int i = 0; i < num_numbers; i++)
+    const auto* bytes = static_cast<const Byte*>(data);
+    uint64_t    hash  = seed + PRIME_3 + size;
+    size_t      i     = 0;
+
+    for(; i + 8 <= size; i += 8)
     {
-        function.numbers.emplace_back(read<Number>(iter));
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash ^= rotate_left(word * PRIME_2, 31) * PRIME_1;
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_3;
     }
 
-    auto num_functions = read<int>(iter);
-    for(int i = 0; i < num_functions; i++)
+    if(i < size)
     {
-        function.functions.emplace_back(read_function(iter));
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, size - i);
+        hash ^= rotate_left(word * PRIME_2, 31) * PRIME_1;
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_3;
     }
 
-    auto num_instructions = read<int>(iter);
-    for(int i = 0; i < num_instructions; i++)
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/*
+ * @brief   Counting sort of the locals by their PC. Two passes over the locals and no
+ *          allocation per PC.
+ */
+PcIndex::PcIndex(const Vector<Local>& locals, unsigned Local::*pc, size_t num_pcs)
+    : m_offsets(num_pcs + 1, 0)
+{
+    for(const auto& local : locals)
     {
-        function.instructions.emplace_back(read<Instruction>(iter));
+        if(local.*pc < num_pcs)
+            m_offsets[local.*pc + 1] += 1;
     }
 
-    return function;
+    for(size_t i = 1; i < m_offsets.size(); ++i)
+        m_offsets[i] += m_offsets[i - 1];
+
+    m_locals.resize(m_offsets.back());
+
+    auto next = Vector<unsigned>(m_offsets.begin(), m_offsets.end() - 1);
+    for(unsigned i = 0; i < locals.size(); ++i)
+    {
+        if(locals[i].*pc < num_pcs)
+            m_locals[next[locals[i].*pc]++] = i;
+    }
 }
 
-Chunk read_chunk(ByteIterator& iter)
+PcIndex::Range PcIndex::operator[](unsigned PC) const
 {
-    Chunk chunk;
+    if(PC + 1 >= m_offsets.size())
+        return {};
 
-    chunk.header = read_header(iter);
-    chunk.main   = read_function(iter);
+    const auto* locals = m_locals.data();
+    return {locals + m_offsets[PC], locals + m_offsets[PC + 1]};
+}
 
-    return chunk;
+LocalScope::LocalScope(const Function& function)
+    : m_spawn(function.locals, &Local::start_pc, function.instructions.size())
+    , m_kill(function.locals, &Local::end_pc, function.instructions.size())
+{
+}
+
+/*
+ * @brief   Spawns the locals that start at PC and kills the ones that ended at the
+ *          previous PC. It has to be called for every PC in ascending order.
+ */
+void LocalScope::advance(unsigned PC)
+{
+    for(const auto index : m_spawn[PC])
+    {
+        // Slots are ordered like the local table.
+        m_alive.insert(std::upper_bound(m_alive.begin(), m_alive.end(), index), index);
+    }
+
+    if(PC == 0)
+        return;
+
+    for(const auto index : m_kill[PC - 1])
+    {
+        // Locals die in reverse order of their creation, usually from the top.
+        const auto it = std::find(m_alive.rbegin(), m_alive.rend(), index);
+        if(it != m_alive.rend())
+            m_alive.erase(std::next(it).base());
+    }
+}
+
+bool LocalScope::has(unsigned slot) const
+{
+    return slot < m_alive.size();
+}
+
+unsigned LocalScope::local(unsigned slot) const
+{
+    return m_alive[slot];
+}
+
+PcIndex::Range LocalScope::spawned(unsigned PC) const
+{
+    return m_spawn[PC];
+}
+
+PcIndex::Range LocalScope::killed(unsigned PC) const
+{
+    return m_kill[PC];
 }
 
 // clang-format off
-std::unordered_map<Operator, std::string> OP_TO_STR = {
+const std::unordered_map<Operator, std::string> OP_TO_STR = {
     {Operator::END,         "END"},
     {Operator::RETURN,      "RETURN"},
     {Operator::CALL,        "CALL"},
@@ -179,7 +869,7 @@ std::unordered_map<Operator, std::string> OP_TO_STR = {
 };
 // clang-format on
 
-void debug_chunk(Chunk chunk)
+void debug_chunk(const Chunk& chunk)
 {
     DebugState state;
 
@@ -201,10 +891,12 @@ void debug_header(ChunkHeader header)
     printf("Test number:           %1.16e\n\n", header.test_number);
 }
 
-void debug_function(DebugState& state, Function function)
+void debug_function(DebugState& state, const Function& function)
 {
+    state.locals = LocalScope(function);
+
     printf("=== Function ===\n");
-    printf("Name:         \"%s\"\n", function.name.c_str());
+    printf("Name:         \"%.*s\"\n", (int)function.name.size(), function.name.data());
     printf("Line:         %d\n", function.line_defined);
     printf("Params:       %d\n", function.number_of_params);
     printf("Variadic:     %s\n", function.is_variadic ? "true" : "false");
@@ -214,22 +906,27 @@ void debug_function(DebugState& state, Function function)
     unsigned n = 0;
     for(const auto& l : function.locals)
     {
-        printf(" %3d: \"%s\" (%u - %u)\n", n++, l.name.c_str(), l.start_pc, l.end_pc);
+        printf(
+            " %3d: \"%.*s\" (%u - %u)\n",
+            n++,
+            (int)l.name.size(),
+            l.name.data(),
+            l.start_pc,
+            l.end_pc);
     }
 
     printf("Globals:      %zu\n", function.globals.size());
     n = 0;
     for(const auto& g : function.globals)
     {
-        printf(" %3d: \"%s\"\n", n++, g.c_str());
+        printf(" %3d: \"%.*s\"\n", n++, (int)g.size(), g.data());
     }
 
     printf("Instructions: %zu\n", function.instructions.size());
-    n = 0;
-    for(const auto& i : function.instructions)
+    for(n = 0; n < function.code.size(); ++n)
     {
-        debug_instruction(state, n, i, function);
-        n++;
+        state.locals.advance(state.PC);
+        debug_instruction(state, n, function);
 
         state.PC++;
     }
@@ -242,29 +939,32 @@ void debug_function(DebugState& state, Function function)
     }
 }
 
-void debug_instruction(DebugState& state, unsigned idx, Instruction instruction, Function& function)
+void debug_instruction(DebugState& state, unsigned idx, const Function& function)
 {
+    const auto& code        = function.code;
+    const auto  instruction = function.instructions[idx];
+
     printf(
         " %3d: %11d (0x%08x) | OP: %2d (0x%02x) (%11s) | "
         "A: %5d (0x%07x) | B: %3d (0x%03x) | U: %10d (0x%08x) | S: %9d (0x%08x)",
         idx,
         (int)instruction,
         (int)instruction,
-        (int)OP(instruction),
-        (int)OP(instruction),
-        OP_TO_STR[OP(instruction)].c_str(),
-        A(instruction),
-        A(instruction),
-        B(instruction),
-        B(instruction),
-        U(instruction),
-        U(instruction),
-        S(instruction),
-        S(instruction));
+        (int)code.op[idx],
+        (int)code.op[idx],
+        OP_TO_STR.at(code.op[idx]).c_str(),
+        code.a[idx],
+        code.a[idx],
+        code.b[idx],
+        code.b[idx],
+        code.u[idx],
+        code.u[idx],
+        code.s[idx],
+        code.s[idx]);
 
     std::string name;
     bool        check_emptyness = true;
-    switch(OP(instruction))
+    switch(code.op[idx])
     {
     case Operator::CALL:
     case Operator::TAILCALL:
@@ -272,32 +972,22 @@ void debug_instruction(DebugState& state, unsigned idx, Instruction instruction,
     case Operator::GETGLOBAL:
     case Operator::PUSHSTRING:
     case Operator::SETGLOBAL:
-        name = function.globals[U(instruction)];
+        name = function.globals[code.u[idx]];
         break;
     case Operator::GETLOCAL:
     case Operator::SETLOCAL:
     {
-        const auto pos = U(instruction);
-
-        auto index = 0;
-        auto i     = 0;
-        while(i != pos)
-        {
-            if(function.locals[index].start_pc <= state.PC &&
-               function.locals[index].end_pc >= state.PC)
-                i++;
-            index++;
-        }
-
-        name = function.locals[index].name;
+        const auto slot = code.u[idx];
+        if(state.locals.has(slot))
+            name = function.locals[state.locals.local(slot)].name;
         break;
     }
     case Operator::PUSHINT:
-        name = std::to_string(S(instruction));
+        name = std::to_string(code.s[idx]);
         break;
     case Operator::PUSHNUM:
     case Operator::PUSHNEGNUM:
-        name = std::to_string(function.numbers[U(instruction)]);
+        name = std::to_string(function.numbers[code.u[idx]]);
         break;
     default:
         check_emptyness = false;
@@ -312,12 +1002,3 @@ void debug_instruction(DebugState& state, unsigned idx, Instruction instruction,
 
     printf("\n");
 }
-
-void quit_on(const bool condition, const Status error, const char* message)
-{
-    if(condition)
-    {
-        printf("%s\n", message);
-        exit(static_cast<int>(error));
-    }
-}
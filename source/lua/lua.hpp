@@ -1,41 +1,65 @@
 #ifndef LUA4DEC_LUA_H
 #define LUA4DEC_LUA_H
 
+#include "errors.hpp"
+
 #include <assert.h>
+#include <deque>
+#include <initializer_list>
 #include <limits>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
 using Byte         = unsigned char;
-using ByteIterator = Byte*;
+using ByteIterator = const Byte*;
 using String       = std::string;
+using StringView   = std::string_view;
 template<typename T>
 using Vector = std::vector<T>;
 
-#ifndef TARGET_ARCH
-#error "You must define a target architecture (32/64)"
-#endif
-
-#if TARGET_ARCH == 32
 using Int         = int32_t;
 using Instruction = uint32_t;
-using SizeT       = uint32_t;
-using Number      = float;
+using Number      = double;  // Numbers of 32 bit chunks are widened when loading.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool HOST_IS_LITTLE_ENDIAN = false;
 #else
-using Int         = int32_t;
-using Instruction = uint32_t;
-using SizeT       = uint64_t;
-using Number      = double;
+constexpr bool HOST_IS_LITTLE_ENDIAN = true;
 #endif
 
+/*
+ * The size of size_t, the size of lua numbers, and the byte order depend on the platform
+ * the chunk was compiled on. The header of the chunk defines the layout and the loader is
+ * instantiated once per supported layout.
+ */
+template<typename SizeType, typename NumberType, bool swap_byte_order = false>
+struct Layout
+{
+    using SizeT  = SizeType;
+    using Number = NumberType;
+
+    static constexpr bool swap = swap_byte_order;
+};
+
+using Layout32 = Layout<uint32_t, float>;
+using Layout64 = Layout<uint64_t, double>;
+
 static constexpr unsigned MAX_INT    = 2147483647 - 2;
 static constexpr Number   LUA_NUMBER = 3.14159265358979323846e8;
 
+// Deeper nested functions are malformed. Each level is a level of recursion when a function
+// is loaded, parsed, and printed, so the limit keeps the stack of a worker small.
+static constexpr unsigned MAX_NESTING = 200;
+
 enum class Operator : Byte
 {
     END = 0x00,
@@ -89,7 +113,7 @@ enum class Operator : Byte
     CLOSURE = 0x30,
 };
 
-extern std::unordered_map<Operator, std::string> OP_TO_STR;
+extern const std::unordered_map<Operator, std::string> OP_TO_STR;
 
 struct ChunkHeader
 {
@@ -104,39 +128,247 @@ struct ChunkHeader
     Number test_number;
 };
 
+/*
+ * Owns the strings that had to be changed while loading. Every other string of a chunk
+ * is a view into the input bytes. Views into the pool stay valid for as long as the pool
+ * exists.
+ */
+class StringPool
+{
+public:
+    StringView store(String&& str);
+
+private:
+    std::deque<String> m_strings;
+};
+
 struct Local
 {
-    String   name;
-    unsigned start_pc;
-    unsigned end_pc;
+    StringView name;
+    unsigned   start_pc;
+    unsigned   end_pc;
+};
+
+/*
+ * Elements that are either borrowed from the input bytes or owned by the array. A
+ * borrowed array is copied into owned storage before it is changed.
+ */
+template<typename T>
+class Array
+{
+public:
+    Array() = default;
+
+    Array(std::initializer_list<T> elements)
+        : m_owned(elements)
+    {
+        update();
+    }
+
+    Array(const Array& other)
+        : m_owned(other.m_owned)
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+    {
+        if(!other.is_borrowed())
+            update();
+    }
+
+    Array(Array&& other) noexcept
+        : m_owned(std::move(other.m_owned))
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+    {
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    Array& operator=(Array other) noexcept
+    {
+        std::swap(m_owned, other.m_owned);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    void borrow(const T* data, size_t size)
+    {
+        m_owned.clear();
+        m_data = data;
+        m_size = size;
+    }
+
+    /*
+     * @brief   Copies 'size' elements from possibly unaligned bytes.
+     */
+    void copy(const Byte* bytes, size_t size)
+    {
+        m_owned.resize(size);
+        if(size > 0)
+            memcpy(m_owned.data(), bytes, size * sizeof(T));
+        update();
+    }
+
+    void push_back(const T& element)
+    {
+        own();
+        m_owned.push_back(element);
+        update();
+    }
+
+    void pop_back()
+    {
+        own();
+        m_owned.pop_back();
+        update();
+    }
+
+    T* mutable_data()
+    {
+        own();
+        return m_owned.data();
+    }
+
+    bool is_borrowed() const
+    {
+        return m_data != nullptr && m_data != m_owned.data();
+    }
+
+    const T* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    const T& operator[](size_t i) const
+    {
+        return m_data[i];
+    }
+
+    const T* begin() const
+    {
+        return m_data;
+    }
+
+    const T* end() const
+    {
+        return m_data + m_size;
+    }
+
+private:
+    void own()
+    {
+        if(is_borrowed())
+            m_owned.assign(m_data, m_data + m_size);
+
+        update();
+    }
+
+    void update()
+    {
+        m_data = m_owned.data();
+        m_size = m_owned.size();
+    }
+
+    Vector<T> m_owned;
+    const T*  m_data = nullptr;
+    size_t    m_size = 0;
+};
+
+/*
+ * The instructions of a function are decoded once when loading. Every argument is stored
+ * in its own column; the arguments of the instruction at PC are op[PC], a[PC], ...
+ */
+struct Code
+{
+    Vector<Operator> op;
+    Vector<uint32_t> a;
+    Vector<uint16_t> b;
+    Vector<uint32_t> u;
+    Vector<int32_t>  s;
+
+    size_t size() const
+    {
+        return op.size();
+    }
 };
 
 struct Function
 {
-    String              name;
-    unsigned            line_defined;
-    unsigned            number_of_params;
-    bool                is_variadic;
-    unsigned            max_stack_size;
-    Vector<Instruction> instructions;
+    StringView          name;
+    unsigned            line_defined     = 0;
+    unsigned            number_of_params = 0;
+    bool                is_variadic      = false;
+    unsigned            max_stack_size   = 0;
+    Array<Instruction>  instructions;
+    Code                code;
     Vector<Number>      numbers;
-    Vector<String>      globals;
+    Vector<StringView>  globals;
     Vector<Local>       locals;
     Vector<unsigned>    lines;
 
     Vector<Function> functions;
 };
 
+/*
+ * The buffer owns the bytes the chunk was read from (a heap copy or a memory mapping of
+ * the file) and the pool owns the strings that were changed while loading. Both are
+ * shared so that the string views of the functions stay valid for as long as the chunk
+ * is in use.
+ */
 struct Chunk
 {
-    ChunkHeader header;
-    Function    main;
+    ChunkHeader                 header;
+    Function                    main;
+    std::shared_ptr<const Byte> buffer;
+    std::shared_ptr<StringPool> strings;
+};
+
+/*
+ * Position of a function in the bytes of a chunk. The entries are recorded by a scan that
+ * skips over the sections of the functions without loading them. Functions are numbered
+ * in the order of the chunk: main is 0 and every function comes before the functions it
+ * contains.
+ */
+struct FunctionEntry
+{
+    size_t     offset = 0;  // of the name of the function
+    size_t     parent = 0;  // number of the enclosing function, main is its own parent
+    unsigned   depth  = 0;
+    StringView name;
+    unsigned   line_defined     = 0;
+    unsigned   number_of_params = 0;
+    size_t     num_globals      = 0;
+    size_t     num_functions    = 0;
+    size_t     num_instructions = 0;
+};
+
+/*
+ * The entries of an index point into the bytes the index was created from. The buffer
+ * keeps these bytes alive like the buffer of a chunk.
+ */
+struct ChunkIndex
+{
+    ChunkHeader                 header;
+    Vector<FunctionEntry>       functions;
+    const Byte*                 data = nullptr;
+    size_t                      size = 0;
+    std::shared_ptr<const Byte> buffer;
 };
 
 constexpr Byte BITS_I      = sizeof(Instruction) * 8;
 constexpr Byte BITS_OP     = 6;
 constexpr Byte BITS_A      = 17;
-constexpr Byte BITS_B      = 9;  // TODO: must be defined at runtime
+constexpr Byte BITS_B      = 9;  // Other widths are converted to this one when loading
 constexpr Byte BITS_U      = 6;
 constexpr Byte BITS_S      = 6;
 constexpr Byte BIT_SHIFT_A = BITS_OP + BITS_B;
@@ -179,35 +411,226 @@ int S(Instruction instruction)
  */
 
 template<typename T>
-T read(ByteIterator& iter, bool advance = true)
+T swap_bytes(T value)
 {
-    T element = *reinterpret_cast<T*>(iter);
-    iter += (advance) ? sizeof(T) : 0;
-    return element;
+    Byte bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    for(size_t i = 0; i < sizeof(T) / 2; ++i)
+    {
+        const Byte byte          = bytes[i];
+        bytes[i]                 = bytes[sizeof(T) - 1 - i];
+        bytes[sizeof(T) - 1 - i] = byte;
+    }
+    memcpy(&value, bytes, sizeof(T));
+    return value;
 }
 
-template<size_t n>
-ByteIterator readn(ByteIterator& iter, bool advance = true)
+/*
+ * Reads the bytes of a chunk front to back. The reader checks with has() once per
+ * section that the section fits into the rest of the input. The reads themselves are not
+ * checked, except for strings whose length is only known while reading.
+ */
+class Cursor
 {
-    ByteIterator bytes = iter;
-    iter += (advance) ? n : 0;
-    return bytes;
-}
+public:
+    Cursor(const Byte* data, size_t size)
+        : m_begin(data)
+        , m_iter(data)
+        , m_end(data + size)
+    {
+    }
+
+    bool has(size_t bytes) const
+    {
+        return remaining() >= bytes;
+    }
+
+    size_t remaining() const
+    {
+        return size_t(m_end - m_iter);
+    }
+
+    size_t offset() const
+    {
+        return size_t(m_iter - m_begin);
+    }
+
+    ByteIterator position() const
+    {
+        return m_iter;
+    }
+
+    void seek(size_t offset)
+    {
+        m_iter = m_begin + offset;
+    }
+
+    void skip(size_t bytes)
+    {
+        m_iter += bytes;
+    }
+
+    template<typename T>
+    T read()
+    {
+        // The input may be a mapped file in which values are not aligned.
+        T element;
+        memcpy(&element, m_iter, sizeof(T));
+        m_iter += sizeof(T);
+        return element;
+    }
+
+    /*
+     * @brief   Reads a value that is stored in the byte order of the layout.
+     */
+    template<typename Layout, typename T>
+    T read_value()
+    {
+        if constexpr(Layout::swap)
+            return swap_bytes(read<T>());
+        else
+            return read<T>();
+    }
+
+    /*
+     * @brief   Copies 'count' values in one block. Values in the other byte order are
+     *          swapped afterwards.
+     */
+    template<typename Layout, typename T>
+    void read_array(T* values, size_t count)
+    {
+        if(count == 0)
+            return;
+
+        memcpy(values, m_iter, count * sizeof(T));
+        m_iter += count * sizeof(T);
+
+        if constexpr(Layout::swap)
+        {
+            for(size_t i = 0; i < count; ++i)
+                values[i] = swap_bytes(values[i]);
+        }
+    }
+
+    /*
+     * @brief   Strings are not copied. The view points into the input bytes. On error the
+     *          cursor points at the part of the string that is missing.
+     */
+    template<typename Layout>
+    Status read_string(StringView& str)
+    {
+        using SizeT = typename Layout::SizeT;
+
+        if(!has(sizeof(SizeT)))
+            return Status::UNEXPECTED_END;
+
+        const auto len = read_value<Layout, SizeT>();
+        if(!has(len))
+            return Status::UNEXPECTED_END;
 
-String      read_string(ByteIterator&);
-String      normalize(String&&);
-ChunkHeader read_header(ByteIterator&);
-Function    read_function(ByteIterator&);
-Chunk       read_chunk(ByteIterator&);
+        auto chars = reinterpret_cast<const char*>(m_iter);
+        str        = StringView(chars, len > 0 ? len - 1 : 0);  // minus zero
+        m_iter += len;
+        return Status::OK;
+    }
+
+private:
+    ByteIterator m_begin;
+    ByteIterator m_iter;
+    ByteIterator m_end;
+};
+
+StringView normalize(StringView, StringPool&);
+Status     read_header(Cursor&, ChunkHeader&);
+Status     read_function(Cursor&, StringPool&, const ChunkHeader&, Function&);
+Error      read_chunk(const Byte* data, size_t size, Chunk&);
+Error      index_chunk(const Byte* data, size_t size, ChunkIndex&);
+Error      read_function_at(const ChunkIndex&, size_t number, Chunk&);
+
+Code   decode(const Instruction*, size_t);
+Status convert_register_b(Instruction*, size_t, Byte bits_for_register_b);
+void   swap_byte_order(Instruction*, size_t);
+
+/*
+ * @brief   Fast 64 bit hash of a block of memory, not suited against attacks. The words are
+ *          read in host byte order, hashes are only comparable on the same kind of host.
+ */
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+/*
+ * Groups the locals of a function by one of their PCs (start or end) in a flat layout.
+ * The locals of a PC are locals[offsets[PC]] up to locals[offsets[PC + 1]], in the order
+ * of the local table. PCs outside of the instructions have no locals.
+ */
+class PcIndex
+{
+public:
+    struct Range
+    {
+        const unsigned* first = nullptr;
+        const unsigned* last  = nullptr;
+
+        const unsigned* begin() const
+        {
+            return first;
+        }
+
+        const unsigned* end() const
+        {
+            return last;
+        }
+
+        size_t size() const
+        {
+            return last - first;
+        }
+    };
+
+    PcIndex() = default;
+    PcIndex(const Vector<Local>& locals, unsigned Local::*pc, size_t num_pcs);
+
+    Range operator[](unsigned PC) const;
+
+private:
+    Vector<unsigned> m_offsets;
+    Vector<unsigned> m_locals;
+};
+
+/*
+ * Keeps track of the locals that are alive at the current PC. A local is alive from its
+ * start PC up to and including its end PC. GETLOCAL and SETLOCAL address a local by its
+ * slot, the position among the living locals. The slot table is updated incrementally
+ * when the PC reaches a start or end PC, so resolving a slot is a single lookup.
+ */
+class LocalScope
+{
+public:
+    LocalScope() = default;
+    LocalScope(const Function& function);
+
+    void     advance(unsigned PC);
+    bool     has(unsigned slot) const;
+    unsigned local(unsigned slot) const;
+
+    // The locals that start or end at PC, as indices into the locals of the function.
+    PcIndex::Range spawned(unsigned PC) const;
+    PcIndex::Range killed(unsigned PC) const;
+
+private:
+    Vector<unsigned> m_alive;  // slot -> index into the locals of the function
+    PcIndex          m_spawn;
+    PcIndex          m_kill;
+};
 
 struct DebugState
 {
-    unsigned PC           = 0;
+    unsigned   PC = 0;
+    LocalScope locals;
 };
 
-void debug_chunk(Chunk chunk);
+void debug_chunk(const Chunk& chunk);
 void debug_header(ChunkHeader chunk);
-void debug_function(DebugState& ctx, Function function);
-void debug_instruction(DebugState& ctx, unsigned idx, Instruction, Function&);
+void debug_function(DebugState& ctx, const Function& function);
+void debug_instruction(DebugState& ctx, unsigned idx, const Function&);
 
 #endif  // LUA4DEC_LUA_H
@@ -1,7 +1,21 @@
 #include "lua4dec.hpp"
 
+#include "io/io.hpp"
+
+#include <filesystem>
+
+/*
+ * @brief   Reads the whole file. Streams that cannot seek (pipes, character devices) are
+ *          read in blocks until EOF. A directory or a read error gives an empty buffer.
+ */
 Vector<Byte> read_file(const char* filename)
 {
+    constexpr size_t BLOCK_SIZE = 1 << 16;
+
+    auto error = std::error_code();
+    if(std::filesystem::is_directory(filename, error))
+        return {};
+
     auto* stream = fopen(filename, "rb");
 
     if(stream == nullptr)
@@ -9,59 +23,378 @@ Vector<Byte> read_file(const char* filename)
         return {};
     }
 
-    fseek(stream, 0, SEEK_END);
-    auto len = ftell(stream);
-    fseek(stream, 0, SEEK_SET);
+    auto buffer = Vector<Byte>();
 
-    auto buffer     = Vector<Byte>(len);
-    auto bytes_read = (long)fread(buffer.data(), 1, len, stream);
-    fclose(stream);
+    if(fseek(stream, 0, SEEK_END) == 0)
+    {
+        const auto len = ftell(stream);
+        if(fseek(stream, 0, SEEK_SET) != 0)
+        {
+            fclose(stream);
+            return {};
+        }
 
-    if(len != bytes_read)
+        if(len > 0)
+            buffer.reserve(static_cast<size_t>(len) + BLOCK_SIZE);
+    }
+
+    size_t size = 0;
+    while(true)
     {
-        printf("Reading error %ld != %ld.\n", len, bytes_read);
-        return {};
+        buffer.resize(size + BLOCK_SIZE);
+
+        const auto bytes_read = fread(buffer.data() + size, 1, BLOCK_SIZE, stream);
+        size += bytes_read;
+
+        if(bytes_read < BLOCK_SIZE)
+            break;
     }
 
+    const auto failed = ferror(stream) != 0;
+    fclose(stream);
+
+    if(failed)
+        return {};
+
+    buffer.resize(size);
     return buffer;
 }
 
-void write_file(const char* filename, Ast const* const ast)
+/*
+ * @brief   An AST of a malformed chunk may not be printable. No partial file is left
+ *          behind in that case.
+ */
+Status write_file(const char* filename, const AstArena& ast)
 {
-    auto* stream = fopen(std::string(filename).append(".lua").c_str(), "w+");
-    print_ast(ast, stream);
+    const auto output = std::string(filename).append(".lua");
+    auto*      stream = fopen(output.c_str(), "w+");
+
+    if(stream == nullptr)
+        return Status::FILE_NOT_WRITABLE;
+
+    try
+    {
+        print_ast(ast, stream);
+    }
+    catch(const std::bad_variant_access&)
+    {
+        fclose(stream);
+        remove(output.c_str());
+        return Status::BAD_VARIANT;
+    }
+
     fclose(stream);
+
+    return Status::OK;
 }
 
-Status create_ast(Ast*& ast, const char* filename)
+Status write_file(const char* filename, StringView text)
 {
-    auto  buffer = read_file(filename);
-    auto* iter   = buffer.data();
-    auto  chunk  = read_chunk(iter);
+    const auto output = std::string(filename).append(".lua");
+    auto*      stream = fopen(output.c_str(), "w+");
+
+    if(stream == nullptr)
+        return Status::FILE_NOT_WRITABLE;
+
+    fwrite(text.data(), 1, text.size(), stream);
+    fclose(stream);
+
+    return Status::OK;
+}
+
+/*
+ * @brief   Decompiles 'main' into <filename>.lua and writes each top-level statement as
+ *          soon as it is final, so the AST of the whole chunk is never held in memory. No
+ *          partial file is left behind on error.
+ */
+Status stream_file(const char* filename, const Function& main, FunctionMemo* memo)
+{
+    const auto output = std::string(filename).append(".lua");
+    auto*      stream = fopen(output.c_str(), "w+");
+
+    if(stream == nullptr)
+        return Status::FILE_NOT_WRITABLE;
+
+    auto ast    = AstArena();
+    auto state  = State();
+    auto result = Status::OK;
+
+    state.memo = memo;
+
+    {
+        StringBuffer buffer(stream);
+        result = parse_function(state, ast, main, buffer);
+    }
+
+    fclose(stream);
+
+    if(result != Status::OK)
+        remove(output.c_str());
+
+    return result;
+}
+
+/*
+ * @brief   The bytes of a file, memory mapped or, for files that cannot be mapped (pipes,
+ *          empty files), copied to the heap. The pointer keeps the bytes alive and is
+ *          empty if the file cannot be read.
+ */
+static std::shared_ptr<const Byte> load_bytes(const char* filename, size_t& size)
+{
+    auto file = std::make_shared<MappedFile>();
+    if(file->open(filename))
+    {
+        size = file->size();
+        return std::shared_ptr<const Byte>(file, file->data());
+    }
+
+    auto buffer = std::make_shared<Vector<Byte>>(read_file(filename));
+    if(buffer->empty())
+        return nullptr;
+
+    size = buffer->size();
+    return std::shared_ptr<const Byte>(buffer, buffer->data());
+}
+
+/*
+ * @brief   Loads a chunk straight out of the memory mapped file. The chunk keeps the
+ *          mapping alive.
+ */
+Error load_chunk(Chunk& chunk, const char* filename)
+{
+    size_t size  = 0;
+    auto   bytes = load_bytes(filename, size);
+    if(!bytes)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    auto error   = read_chunk(bytes.get(), size, chunk);
+    chunk.buffer = bytes;
+
+    return error;
+}
+
+/*
+ * @brief   Records where each function of the file starts without loading any of them.
+ */
+Error load_index(ChunkIndex& index, const char* filename)
+{
+    size_t size  = 0;
+    auto   bytes = load_bytes(filename, size);
+    if(!bytes)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    auto error   = index_chunk(bytes.get(), size, index);
+    index.buffer = bytes;
+
+    return error;
+}
+
+/*
+ * @brief   Loads only the function 'number' of the file (see load_index) as the main
+ *          function of the chunk.
+ */
+Error load_function(Chunk& chunk, const char* filename, size_t number)
+{
+    ChunkIndex index;
+
+    auto error = load_index(index, filename);
+    if(error.status != Status::OK)
+        return error;
+
+    return read_function_at(index, number, chunk);
+}
+
+Status create_ast(AstArena& ast, const char* filename)
+{
+    Chunk chunk;
+    auto  error = load_chunk(chunk, filename);
+    if(error.status != Status::OK)
+        return error.status;
 
     auto state = State();
     return parse_function(state, ast, chunk.main);
 }
 
-void delete_ast(Ast*& ast)
+/*
+ * @brief   Decompiles the chunk in memory into 'text'. The arena and the text are cleared
+ *          first, so a caller that decompiles many chunks can keep their memory.
+ */
+Error decompile_to_text(
+    const Byte*   data,
+    size_t        size,
+    AstArena&     ast,
+    StringBuffer& text,
+    FunctionMemo* memo)
+{
+    ast.clear();
+    text.clear();
+
+    Chunk chunk;
+    auto  error = read_chunk(data, size, chunk);
+    if(error.status != Status::OK)
+        return error;
+
+    auto state   = State();
+    state.memo   = memo;
+    error.status = parse_function(state, ast, chunk.main);
+
+    if(error.status == Status::OK)
+    {
+        try
+        {
+            print_ast(ast, text);
+        }
+        catch(const std::bad_variant_access&)
+        {
+            error.status = Status::BAD_VARIANT;
+        }
+    }
+
+    return error;
+}
+
+Error decompile_to_text(
+    const char*   filename,
+    AstArena&     ast,
+    StringBuffer& text,
+    FunctionMemo* memo)
+{
+    size_t size  = 0;
+    auto   bytes = load_bytes(filename, size);
+    if(!bytes)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    return decompile_to_text(bytes.get(), size, ast, text, memo);
+}
+
+/*
+ * @brief   Decompiles the file into 'text', or takes the text from the cache if this
+ *          version decompiled the same bytes before. Failed decompilations are cached as
+ *          well, only a file that cannot be read is not.
+ */
+Error decompile_cached(
+    const char*   filename,
+    ResultCache&  cache,
+    String&       text,
+    FunctionMemo* memo)
+{
+    size_t size  = 0;
+    auto   bytes = load_bytes(filename, size);
+    if(!bytes)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    const auto key   = ResultCache::key(bytes.get(), size);
+    auto       entry = CacheEntry();
+
+    if(!cache.load(key, size, entry))
+    {
+        auto ast    = AstArena();
+        auto buffer = StringBuffer();
+        auto error  = decompile_to_text(bytes.get(), size, ast, buffer, memo);
+
+        entry.status = error.status;
+        entry.offset = error.offset;
+        if(entry.status == Status::OK)
+            entry.text = buffer.str();
+
+        cache.store(key, size, entry);
+    }
+
+    text = std::move(entry.text);
+
+    return Error{entry.status, entry.offset};
+}
+
+/*
+ * @brief   Decompiles the file and prints it to 'output', if given, while the time of each
+ *          phase and the counters of the parser are recorded in 'metrics'. The spans go
+ *          into 'tracer' and the times of the handlers into 'profile', if given.
+ */
+Error decompile_measured(
+    const char*     filename,
+    FILE*           output,
+    Metrics&        metrics,
+    FunctionMemo*   memo,
+    Tracer*         tracer,
+    HandlerProfile* profile)
 {
-    while(ast->child)
+    metrics.filename = filename;
+
+    const auto file = String("\"file\": ") + json_string(filename);
+
+    // The time of a phase goes into the metrics and, as a span, into the trace.
+    const auto finish = [&](Phase phase, Metrics::Clock::time_point start)
     {
-        ast = ast->child;
+        metrics.add(phase, start);
+        if(tracer)
+            tracer->span(PHASE_TO_STR[static_cast<size_t>(phase)], start, file);
+    };
+
+    const auto begin = Metrics::Clock::now();
+
+    auto   start = begin;
+    size_t size  = 0;
+    auto   bytes = load_bytes(filename, size);
+    finish(Phase::READ, start);
+
+    if(!bytes)
+    {
+        metrics.status = Status::FILE_NOT_READABLE;
+        return Error{metrics.status, 0};
+    }
+
+    Chunk chunk;
+    start      = Metrics::Clock::now();
+    auto error = read_chunk(bytes.get(), size, chunk);
+    finish(Phase::LOAD, start);
+
+    if(error.status == Status::OK)
+    {
+        auto ast      = AstArena();
+        auto state    = State();
+        state.memo    = memo;
+        state.metrics = &metrics;
+        state.tracer  = tracer;
+        state.profile = profile;
+
+        start        = Metrics::Clock::now();
+        error.status = parse_function(state, ast, chunk.main);
+        finish(Phase::PARSE, start);
+
+        metrics.nodes = count_nodes(ast);
+
+        if(error.status == Status::OK && output)
+        {
+            start = Metrics::Clock::now();
+            try
+            {
+                print_ast(ast, output);
+            }
+            catch(const std::bad_variant_access&)
+            {
+                error.status = Status::BAD_VARIANT;
+            }
+            finish(Phase::PRINT, start);
+        }
     }
 
-    while(ast->parent)
+    metrics.status = error.status;
+
+    if(tracer)
     {
-        ast = ast->parent;
-        delete ast->child;
+        const auto& status = STATUS_TO_STR.at(error.status);
+        tracer->span("decompile", begin, file + ", \"status\": \"" + status + "\"");
     }
+
+    return error;
 }
 
-Status parse(Ast*& ast, const char* filename, FILE* stream)
+Status parse(AstArena& ast, const char* filename, FILE* stream)
 {
-    auto  buffer = read_file(filename);
-    auto* iter   = buffer.data();
-    auto  chunk  = read_chunk(iter);
+    Chunk chunk;
+    auto  loaded = load_chunk(chunk, filename);
+    if(loaded.status != Status::OK)
+        return loaded.status;
 
     auto state = State();
     auto error = parse_function(state, ast, chunk.main);
@@ -1,7 +1,43 @@
+#ifndef LUA4DEC_H
+#define LUA4DEC_H
+
+#include "cache/cache.hpp"
 #include "parser/parser.hpp"
 
 Vector<Byte> read_file(const char* filename);
-void         write_file(const char* filename, Ast const* const ast);
-Status       create_ast(Ast*& ast, const char* filename);
-void         delete_ast(Ast*& ast);
-Status       parse(Ast*& ast, const char* filename, FILE* stream);
+Status       write_file(const char* filename, const AstArena& ast);
+Status       write_file(const char* filename, StringView text);
+Status       stream_file(
+    const char*     filename,
+    const Function& main,
+    FunctionMemo*   memo = nullptr);
+Error        load_chunk(Chunk& chunk, const char* filename);
+Error        load_index(ChunkIndex& index, const char* filename);
+Error        load_function(Chunk& chunk, const char* filename, size_t number);
+Status       create_ast(AstArena& ast, const char* filename);
+Error        decompile_to_text(
+    const Byte*   data,
+    size_t        size,
+    AstArena&     ast,
+    StringBuffer& text,
+    FunctionMemo* memo = nullptr);
+Error        decompile_to_text(
+    const char*   filename,
+    AstArena&     ast,
+    StringBuffer& text,
+    FunctionMemo* memo = nullptr);
+Error        decompile_cached(
+    const char*   filename,
+    ResultCache&  cache,
+    String&       text,
+    FunctionMemo* memo = nullptr);
+Error        decompile_measured(
+    const char*     filename,
+    FILE*           output,
+    Metrics&        metrics,
+    FunctionMemo*   memo    = nullptr,
+    Tracer*         tracer  = nullptr,
+    HandlerProfile* profile = nullptr);
+Status       parse(AstArena& ast, const char* filename, FILE* stream);
+
+#endif  // LUA4DEC_H
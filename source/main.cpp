@@ -1,39 +1,526 @@
+#include "batch/batch.hpp"
 #include "lua4dec.hpp"
+#include "server/server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <optional>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief   Decompiles every input on its own worker and writes the <file>.lua outputs.
+ *          With a report file, the metrics of all files are written to it, with a trace
+ *          file the spans of all workers. The profile of the handlers of all files is
+ *          printed to stderr. Returns the number of files that failed.
+ */
+int run_batch(
+    int          argc,
+    char**       argv,
+    int          threads,
+    BatchOptions options,
+    const char*  report,
+    const char*  trace,
+    bool         profile)
+{
+    Vector<String> inputs(argv + 1, argv + argc);
+
+    const auto files = collect_files(inputs);
+    if(files.empty())
+    {
+        printf("No files to decompile.\n");
+        return 1;
+    }
+
+    // All hardware threads are used unless the number is given.
+    auto pool = ThreadPool(threads < 0 ? 0 : unsigned(threads));
+
+    // Identical closures are parsed once for all files.
+    auto memo       = FunctionMemo();
+    options.memo    = &memo;
+    options.measure = report != nullptr;
+
+    auto tracer    = Tracer();
+    options.tracer = trace ? &tracer : nullptr;
+
+    auto handlers   = HandlerProfile();
+    options.profile = profile ? &handlers : nullptr;
+
+    const auto start   = std::chrono::steady_clock::now();
+    const auto results = decompile_batch(files, pool, stdout, options);
+    const auto seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_summary(results, seconds, stdout);
+    print_memo_summary(memo, stdout);
+
+    const auto exceptions = pool.take_exceptions();
+    if(!exceptions.empty())
+        printf("%zu tasks ended with an exception.\n", exceptions.size());
+
+    if(report)
+    {
+        Vector<Metrics> metrics;
+        for(const auto& result : results)
+            metrics.push_back(result.metrics);
+
+        if(!write_metrics(report, metrics))
+            printf("Could not write the report %s.\n", report);
+    }
+
+    if(trace && !tracer.write(trace))
+        printf("Could not write the trace %s.\n", trace);
+
+    if(profile)
+        handlers.print(stderr);
+
+    int failed = 0;
+    for(const auto& result : results)
+        failed += result.status != Status::OK;
+
+    return failed;
+}
+
+/*
+ * @brief   Prints the functions of a chunk with the numbers that select them with -f.
+ *          Nested functions are indented below the function that contains them.
+ */
+int list_functions(const char* filename)
+{
+    ChunkIndex index;
+
+    auto error = load_index(index, filename);
+    if(error.status != Status::OK)
+    {
+        printf(
+            "Could not read file: %s (%s at byte %zu)\n",
+            filename,
+            STATUS_TO_STR.at(error.status).c_str(),
+            error.offset);
+        return static_cast<int>(error.status);
+    }
+
+    printf(
+        "%5s %10s %6s %6s %8s %9s %12s  %s\n",
+        "#",
+        "offset",
+        "line",
+        "params",
+        "globals",
+        "functions",
+        "instructions",
+        "name");
+
+    for(size_t i = 0; i < index.functions.size(); ++i)
+    {
+        const auto& entry = index.functions[i];
+
+        printf(
+            "%5zu %10zu %6u %6u %8zu %9zu %12zu  %*s%.*s\n",
+            i,
+            entry.offset,
+            entry.line_defined,
+            entry.number_of_params,
+            entry.num_globals,
+            entry.num_functions,
+            entry.num_instructions,
+            int(entry.depth * 2),
+            "",
+            int(entry.name.size()),
+            entry.name.data());
+    }
+
+    return 0;
+}
+
+/*
+ * @brief   Single file mode that takes the result from the cache if the file was
+ *          decompiled before.
+ */
+int decompile_with_cache(int argc, char** argv, ResultCache& cache)
+{
+    String text;
+    auto   memo = FunctionMemo();
+
+    // Like without the cache, only the failures of loading the chunk are reported.
+    auto error     = decompile_cached(argv[1], cache, text, &memo);
+    auto is_parsed = error.status == Status::OK || error.status == Status::EMPTY_STACK ||
+                     error.status == Status::BAD_VARIANT;
+
+    if(!is_parsed)
+    {
+        printf(
+            "Could not read file: %s (%s at byte %zu)\n",
+            argv[1],
+            STATUS_TO_STR.at(error.status).c_str(),
+            error.offset);
+    }
+    else if(error.status == Status::OK)
+    {
+        fwrite(text.data(), 1, text.size(), stdout);
+
+        if(argc == 3)
+            write_file(argv[2], text);
+    }
+
+    return static_cast<int>(error.status);
+}
+
+/*
+ * @brief   Single file mode that records the time of each phase and the counters of the
+ *          parser, and writes them to the report file and the spans to the trace file.
+ *          Either file can be missing. The profile of the handlers is printed to stderr,
+ *          so that it does not mix with the source on stdout.
+ */
+int decompile_with_metrics(
+    int         argc,
+    char**      argv,
+    const char* report,
+    const char* trace,
+    bool        profile)
+{
+    const auto filename = argc == 3 ? std::string(argv[2]).append(".lua") : std::string();
+
+    auto* output = stdout;
+    if(argc == 3)
+        output = fopen(filename.c_str(), "w+");
+
+    if(output == nullptr)
+        return static_cast<int>(Status::FILE_NOT_WRITABLE);
+
+    auto metrics = Metrics();
+    auto memo    = FunctionMemo();
+    auto tracer  = Tracer();
+    auto handler = HandlerProfile();
+    auto error   = decompile_measured(
+        argv[1], output, metrics, &memo, &tracer, profile ? &handler : nullptr);
+
+    // No partial file is left behind, like in streaming and batch mode.
+    if(output != stdout)
+    {
+        fclose(output);
+        if(error.status != Status::OK)
+            remove(filename.c_str());
+    }
+
+    if(error.status != Status::OK && error.status != Status::EMPTY_STACK &&
+       error.status != Status::BAD_VARIANT)
+    {
+        printf(
+            "Could not read file: %s (%s at byte %zu)\n",
+            argv[1],
+            STATUS_TO_STR.at(error.status).c_str(),
+            error.offset);
+    }
+
+    if(report && !write_metrics(report, {metrics}))
+        printf("Could not write the report %s.\n", report);
+
+    if(trace && !tracer.write(trace))
+        printf("Could not write the trace %s.\n", trace);
+
+    if(profile)
+        handler.print(stderr);
+
+    return static_cast<int>(error.status);
+}
+
+/*
+ * The server that is stopped by SIGINT and SIGTERM.
+ */
+static DecompileServer* running_server = nullptr;
+
+static void stop_server(int)
+{
+    if(running_server)
+        running_server->stop();
+}
+
+/*
+ * @brief   Server mode that decompiles the requests of local clients until it is
+ *          interrupted.
+ */
+int serve(const char* socket, int threads)
+{
+    auto pool   = ThreadPool(threads < 0 ? 0 : unsigned(threads));
+    auto memo   = FunctionMemo();
+    auto server = DecompileServer(socket, pool, &memo);
+
+    if(!server.listen())
+    {
+        printf("Could not listen on %s.\n", socket);
+        return 1;
+    }
+
+    running_server = &server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+
+    printf("Listening on %s with %u workers.\n", socket, pool.size());
+    fflush(stdout);
+
+    server.serve();
+    running_server = nullptr;
+
+    print_memo_summary(memo, stdout);
+
+    return 0;
+}
+
+/*
+ * @brief   Single file mode that lets the server at 'socket' decompile the file.
+ */
+int decompile_with_server(int argc, char** argv, const char* socket)
+{
+    // The server may have another working directory.
+    std::error_code error_code;
+    const auto      path = std::filesystem::absolute(argv[1], error_code).string();
+
+    String text;
+    auto   error = request_decompile(socket, RequestKind::PATH, path, text);
+
+    if(error.status == Status::OK)
+    {
+        fwrite(text.data(), 1, text.size(), stdout);
+
+        if(argc == 3)
+            write_file(argv[2], text);
+    }
+    else
+    {
+        printf(
+            "Could not decompile file: %s (%s at byte %zu)\n",
+            argv[1],
+            STATUS_TO_STR.at(error.status).c_str(),
+            error.offset);
+    }
+
+    return static_cast<int>(error.status);
+}
 
 int main(int argc, char** argv)
 {
-    Vector<Byte> buffer;
+    Chunk chunk;
+
+    // Number of worker threads (-j), 0 uses all hardware threads. A single file is parsed
+    // on this thread unless the number is given.
+    int  threads = -1;
+    bool batch   = false;
+
+    // Only the functions of the chunk are listed (-l), or only the function with the
+    // number of the list is decompiled (-f).
+    bool list     = false;
+    int  function = -1;
+
+    // Top-level statements are printed as soon as they are final (-s) instead of after
+    // the whole chunk is parsed.
+    bool streaming = false;
+
+    // Results are kept in and taken from the cache directory (-c).
+    const char* cache_directory = nullptr;
+
+    // Phase timings and parser counters are written to a JSON report (-m).
+    const char* report = nullptr;
+
+    // Spans of the phases and of every parsed function are written to a trace file (-t)
+    // in the Trace Event Format.
+    const char* trace = nullptr;
+
+    // The time of every handler call is recorded and printed as histograms per
+    // operator (-p).
+    bool profile = false;
+
+    // The decompiler runs as a server on a local socket (-S), or a file is sent to such a
+    // server (-R).
+    const char* serve_socket   = nullptr;
+    const char* request_socket = nullptr;
+
+    while(argc > 1 && argv[1][0] == '-')
+    {
+        if(strcmp(argv[1], "-j") == 0 && argc > 2)
+        {
+            threads = std::max(0, atoi(argv[2]));
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-b") == 0)
+        {
+            batch = true;
+        }
+        else if(strcmp(argv[1], "-l") == 0)
+        {
+            list = true;
+        }
+        else if(strcmp(argv[1], "-s") == 0)
+        {
+            streaming = true;
+        }
+        else if(strcmp(argv[1], "-c") == 0 && argc > 2)
+        {
+            cache_directory = argv[2];
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-m") == 0 && argc > 2)
+        {
+            report = argv[2];
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-t") == 0 && argc > 2)
+        {
+            trace = argv[2];
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-p") == 0)
+        {
+            profile = true;
+        }
+        else if(strcmp(argv[1], "-S") == 0 && argc > 2)
+        {
+            serve_socket = argv[2];
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-R") == 0 && argc > 2)
+        {
+            request_socket = argv[2];
+            argc -= 1;
+            argv += 1;
+        }
+        else if(strcmp(argv[1], "-f") == 0 && argc > 2)
+        {
+            function = std::max(0, atoi(argv[2]));
+            argc -= 1;
+            argv += 1;
+        }
+        else
+        {
+            break;
+        }
+
+        argc -= 1;
+        argv += 1;
+    }
+
+    if(serve_socket)
+        return serve(serve_socket, threads);
 
     if(argc < 2)
     {
         printf("Please provide a compiled lua script as argument.\n");
         return 1;
     }
-    else if(argc == 2)
+
+    // A mode would ignore the options it does not use, they are rejected instead.
+    const auto  measured = report || trace || profile;
+    const char* conflict = nullptr;
+
+    if(cache_directory && (measured || function >= 0))
+        conflict = "-c cannot be combined with -m, -t, -p or -f, they skip the cache.";
+    else if(streaming && cache_directory)
+        conflict = "-s cannot be combined with -c, cached results are not streamed.";
+    else if(streaming && !batch && (measured || threads >= 0))
+        conflict = "-s cannot be combined with -m, -t, -p or -j for a single file.";
+    else if(function >= 0 && measured)
+        conflict = "-f cannot be combined with -m, -t or -p.";
+
+    if(conflict)
     {
+        printf("%s\n", conflict);
+        return 2;
+    }
 
-#ifndef NDEBUG
-        printf("Reading file: %s\n", argv[1]);
-#endif
+    auto cache = std::optional<ResultCache>();
+    if(cache_directory)
+        cache.emplace(cache_directory);
 
-        buffer = read_file(argv[1]);
+    if(batch)
+    {
+        auto options  = BatchOptions();
+        options.cache = cache ? &*cache : nullptr;
+        return run_batch(argc, argv, threads, options, report, trace, profile);
     }
     else if(argc > 3)
     {
-        // pipe it here
+        printf("Use -b to decompile more than one file.\n");
         return 2;
     }
+    else if(list)
+    {
+        return list_functions(argv[1]);
+    }
+    else if(request_socket)
+    {
+        return decompile_with_server(argc, argv, request_socket);
+    }
+    else if(measured)
+    {
+        return decompile_with_metrics(argc, argv, report, trace, profile);
+    }
+    else if(cache)
+    {
+        return decompile_with_cache(argc, argv, *cache);
+    }
 
-    auto* iter  = buffer.data();
-    auto  chunk = read_chunk(iter);
+#ifndef NDEBUG
+    printf("Reading file: %s\n", argv[1]);
+#endif
+
+    auto error = function < 0 ? load_chunk(chunk, argv[1])
+                              : load_function(chunk, argv[1], size_t(function));
+    if(error.status != Status::OK)
+    {
+        printf(
+            "Could not read file: %s (%s at byte %zu)\n",
+            argv[1],
+            STATUS_TO_STR.at(error.status).c_str(),
+            error.offset);
+        return static_cast<int>(error.status);
+    }
 
 #ifndef NDEBUG
     debug_chunk(chunk);
 #endif
 
-    auto* ast    = new Ast();
-    auto  state  = State();
-    auto  result = parse_function(state, ast, chunk.main);
+    // Identical closures of the chunk are parsed once.
+    auto memo = FunctionMemo();
+
+    if(streaming && argc == 3)
+    {
+        return static_cast<unsigned>(stream_file(argv[2], chunk.main, &memo));
+    }
+    else if(streaming)
+    {
+        auto ast    = AstArena();
+        auto state  = State();
+        auto buffer = StringBuffer(stdout);
+        state.memo  = &memo;
+
+        return static_cast<unsigned>(parse_function(state, ast, chunk.main, buffer));
+    }
+
+    auto ast    = AstArena();
+    auto state  = State();
+    auto result = Status::OK;
+    state.memo  = &memo;
+
+    if(threads < 0 || threads == 1)
+    {
+        result = parse_function(state, ast, chunk.main);
+    }
+    else
+    {
+        auto pool = ThreadPool(unsigned(threads));
+        result    = parse_function(state, ast, chunk.main, pool);
+    }
+
+#ifndef NDEBUG
+    printf("Reused %zu of %zu closures.\n", memo.hits(), memo.hits() + memo.misses());
+#endif
 
     if(result == Status::OK)
     {
@@ -0,0 +1,366 @@
+#include "metrics/metrics.hpp"
+
+const char* PHASE_TO_STR[NUM_PHASES] = {"read", "load", "parse", "print"};
+
+/*
+ * Process id of every event in a trace, there is only one process.
+ */
+static constexpr int TRACE_PROCESS = 1;
+
+/*
+ * Number of functions of a file in the report, the slowest ones.
+ */
+static constexpr size_t REPORTED_FUNCTIONS = 10;
+
+size_t Metrics::instructions() const
+{
+    size_t sum = 0;
+    for(const auto count : operators)
+        sum += count;
+
+    return sum;
+}
+
+double Metrics::total_seconds() const
+{
+    double sum = 0;
+    for(const auto phase : seconds)
+        sum += phase;
+
+    return sum;
+}
+
+String json_string(StringView text)
+{
+    String json = "\"";
+
+    for(const char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            json += '\\';
+            json += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            json += escaped;
+        }
+        else
+        {
+            json += c;
+        }
+    }
+
+    return json += '"';
+}
+
+/*
+ * @brief   The counters of one file or of the sums, without the name and the functions.
+ */
+static void write_counters(FILE* stream, const Metrics& metrics, const char* indent)
+{
+    fprintf(stream, "%s\"seconds\": %.9f,\n", indent, metrics.total_seconds());
+
+    fprintf(stream, "%s\"phases\": {", indent);
+    for(size_t i = 0; i < NUM_PHASES; ++i)
+    {
+        const auto* separator = i > 0 ? ", " : "";
+        fprintf(stream, "%s\"%s\": %.9f", separator, PHASE_TO_STR[i], metrics.seconds[i]);
+    }
+    fprintf(stream, "},\n");
+
+    fprintf(stream, "%s\"instructions\": %zu,\n", indent, metrics.instructions());
+    fprintf(stream, "%s\"peak_stack\": %zu,\n", indent, metrics.peak_stack);
+    fprintf(
+        stream,
+        "%s\"nodes\": {\"blocks\": %zu, \"statements\": %zu, \"expressions\": %zu},\n",
+        indent,
+        metrics.nodes.blocks,
+        metrics.nodes.statements,
+        metrics.nodes.expressions);
+
+    // Only the operators that occur.
+    fprintf(stream, "%s\"operators\": {", indent);
+    bool is_first = true;
+    for(size_t op = 0; op < metrics.operators.size(); ++op)
+    {
+        if(metrics.operators[op] == 0)
+            continue;
+
+        const auto name = OP_TO_STR.find(Operator(op));
+        fprintf(stream, is_first ? "" : ", ");
+        if(name != OP_TO_STR.end())
+            fprintf(stream, "\"%s\": %zu", name->second.c_str(), metrics.operators[op]);
+        else
+            fprintf(stream, "\"0x%02zx\": %zu", op, metrics.operators[op]);
+
+        is_first = false;
+    }
+    fprintf(stream, "}");
+}
+
+bool write_metrics(const char* filename, const Vector<Metrics>& files)
+{
+    auto* stream = fopen(filename, "w");
+    if(stream == nullptr)
+        return false;
+
+    Vector<const Metrics*> sorted;
+    for(const auto& file : files)
+        sorted.push_back(&file);
+
+    std::stable_sort(
+        sorted.begin(),
+        sorted.end(),
+        [](const Metrics* first, const Metrics* second)
+        { return first->total_seconds() > second->total_seconds(); });
+
+    Metrics total;
+    size_t  failed = 0;
+
+    fprintf(stream, "{\n  \"files\": [\n");
+
+    for(size_t i = 0; i < sorted.size(); ++i)
+    {
+        const auto& file = *sorted[i];
+
+        fprintf(
+            stream,
+            "    {\n      \"file\": %s,\n      \"status\": \"%s\",\n",
+            json_string(file.filename).c_str(),
+            STATUS_TO_STR.at(file.status).c_str());
+        write_counters(stream, file, "      ");
+
+        auto functions = file.functions;
+        std::stable_sort(
+            functions.begin(),
+            functions.end(),
+            [](const FunctionMetrics& first, const FunctionMetrics& second)
+            { return first.seconds > second.seconds; });
+        functions.resize(std::min(functions.size(), REPORTED_FUNCTIONS));
+
+        fprintf(stream, ",\n      \"functions\": [");
+        for(size_t f = 0; f < functions.size(); ++f)
+        {
+            fprintf(
+                stream,
+                "%s{\"line\": %u, \"instructions\": %zu, \"seconds\": %.9f}",
+                f > 0 ? ", " : "",
+                functions[f].line_defined,
+                functions[f].instructions,
+                functions[f].seconds);
+        }
+        fprintf(stream, "]\n    }%s\n", i + 1 < sorted.size() ? "," : "");
+
+        for(size_t p = 0; p < NUM_PHASES; ++p)
+            total.seconds[p] += file.seconds[p];
+        for(size_t op = 0; op < total.operators.size(); ++op)
+            total.operators[op] += file.operators[op];
+
+        total.peak_stack = std::max(total.peak_stack, file.peak_stack);
+        total.nodes.blocks += file.nodes.blocks;
+        total.nodes.statements += file.nodes.statements;
+        total.nodes.expressions += file.nodes.expressions;
+        failed += file.status != Status::OK;
+    }
+
+    fprintf(stream, "  ],\n  \"total\": {\n");
+    fprintf(stream, "    \"files\": %zu,\n    \"failed\": %zu,\n", files.size(), failed);
+    write_counters(stream, total, "    ");
+    fprintf(stream, "\n  }\n}\n");
+
+    return fclose(stream) == 0;
+}
+
+uint64_t HandlerHistogram::percentile(double fraction) const
+{
+    const auto wanted = uint64_t(double(calls) * fraction);
+    uint64_t   sum    = 0;
+
+    for(size_t i = 0; i < buckets.size(); ++i)
+    {
+        sum += buckets[i];
+        if(sum > wanted || sum == calls)
+            return std::min(uint64_t(1) << i, max);
+    }
+
+    return max;
+}
+
+void HandlerProfile::merge(const HandlerProfile& other)
+{
+    std::scoped_lock lock(m_mutex, other.m_mutex);
+
+    for(size_t op = 0; op < m_operators.size(); ++op)
+    {
+        auto&       histogram = m_operators[op];
+        const auto& added     = other.m_operators[op];
+
+        for(size_t i = 0; i < histogram.buckets.size(); ++i)
+            histogram.buckets[i] += added.buckets[i];
+
+        histogram.calls += added.calls;
+        histogram.nanoseconds += added.nanoseconds;
+        histogram.max = std::max(histogram.max, added.max);
+    }
+}
+
+void HandlerProfile::print(FILE* stream) const
+{
+    // Width of the longest bar of a histogram.
+    static constexpr uint64_t BAR_WIDTH = 40;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Vector<size_t> sorted;
+    uint64_t       total = 0;
+    for(size_t op = 0; op < m_operators.size(); ++op)
+    {
+        if(m_operators[op].calls == 0)
+            continue;
+
+        sorted.push_back(op);
+        total += m_operators[op].nanoseconds;
+    }
+
+    std::stable_sort(
+        sorted.begin(),
+        sorted.end(),
+        [this](size_t first, size_t second)
+        { return m_operators[first].nanoseconds > m_operators[second].nanoseconds; });
+
+    const auto name = [](size_t op)
+    {
+        const auto found = OP_TO_STR.find(Operator(op));
+        if(found != OP_TO_STR.end())
+            return found->second;
+
+        return String("0x") + std::to_string(op);
+    };
+
+    fprintf(
+        stream,
+        "%-12s %12s %12s %7s %9s %9s %9s %11s\n",
+        "operator",
+        "calls",
+        "total ms",
+        "share",
+        "mean ns",
+        "p50 ns",
+        "p99 ns",
+        "max ns");
+
+    for(const auto op : sorted)
+    {
+        const auto& histogram = m_operators[op];
+
+        fprintf(
+            stream,
+            "%-12s %12llu %12.3f %6.1f%% %9.0f %9llu %9llu %11llu\n",
+            name(op).c_str(),
+            static_cast<unsigned long long>(histogram.calls),
+            double(histogram.nanoseconds) / 1e6,
+            total > 0 ? 100.0 * double(histogram.nanoseconds) / double(total) : 0.0,
+            double(histogram.nanoseconds) / double(histogram.calls),
+            static_cast<unsigned long long>(histogram.percentile(0.5)),
+            static_cast<unsigned long long>(histogram.percentile(0.99)),
+            static_cast<unsigned long long>(histogram.max));
+    }
+
+    // Only the buckets from the first to the last one that has calls.
+    for(const auto op : sorted)
+    {
+        const auto& histogram = m_operators[op];
+        const auto& buckets   = histogram.buckets;
+        const auto  most      = *std::max_element(buckets.begin(), buckets.end());
+
+        size_t first = 0;
+        size_t last  = histogram.buckets.size() - 1;
+        while(histogram.buckets[first] == 0)
+            first += 1;
+        while(histogram.buckets[last] == 0)
+            last -= 1;
+
+        fprintf(stream, "\n%s\n", name(op).c_str());
+        for(size_t i = first; i <= last; ++i)
+        {
+            const auto count = histogram.buckets[i];
+            const auto bar   = String(size_t((count * BAR_WIDTH + most - 1) / most), '#');
+            fprintf(
+                stream,
+                "  < %11llu ns %12llu %s\n",
+                static_cast<unsigned long long>(uint64_t(1) << i),
+                static_cast<unsigned long long>(count),
+                bar.c_str());
+        }
+    }
+}
+
+Tracer::Tracer()
+    : m_start(Clock::now())
+{
+}
+
+/*
+ * @brief   Threads are numbered in the order of their first span.
+ */
+void Tracer::span(StringView name, Clock::time_point start, String args)
+{
+    const auto end = Clock::now();
+
+    auto event     = Event();
+    event.name     = String(name);
+    event.args     = std::move(args);
+    event.start    = std::chrono::duration<double, std::micro>(start - m_start).count();
+    event.duration = std::chrono::duration<double, std::micro>(end - start).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto id     = std::this_thread::get_id();
+    const auto thread = m_threads.emplace(id, unsigned(m_threads.size())).first;
+    event.thread      = thread->second;
+
+    m_events.push_back(std::move(event));
+}
+
+size_t Tracer::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_events.size();
+}
+
+/*
+ * @brief   Every span is a complete event ("ph": "X") with its start and duration.
+ */
+bool Tracer::write(const char* filename) const
+{
+    auto* stream = fopen(filename, "w");
+    if(stream == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    fprintf(stream, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    for(size_t i = 0; i < m_events.size(); ++i)
+    {
+        const auto& event = m_events[i];
+        fprintf(
+            stream,
+            "{\"name\": %s, \"cat\": \"lua4dec\", \"ph\": \"X\", \"ts\": %.3f, "
+            "\"dur\": %.3f, \"pid\": %d, \"tid\": %u, \"args\": {%s}}%s\n",
+            json_string(event.name).c_str(),
+            event.start,
+            event.duration,
+            TRACE_PROCESS,
+            event.thread,
+            event.args.c_str(),
+            i + 1 < m_events.size() ? "," : "");
+    }
+
+    fprintf(stream, "]}\n");
+
+    return fclose(stream) == 0;
+}
@@ -0,0 +1,204 @@
+#ifndef LUA4DEC_METRICS_H
+#define LUA4DEC_METRICS_H
+
+#include "ast/ast.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+/*
+ * Phases of decompiling one file.
+ */
+enum class Phase : unsigned
+{
+    READ = 0x00,  // mapping or reading the file
+    LOAD,         // read_chunk
+    PARSE,        // parse_function
+    PRINT,        // print_ast
+    UNDEFINED,
+};
+
+constexpr size_t NUM_PHASES = static_cast<size_t>(Phase::UNDEFINED);
+
+extern const char* PHASE_TO_STR[NUM_PHASES];
+
+/*
+ * Time spent in parsing one function, including the functions nested in it.
+ */
+struct FunctionMetrics
+{
+    unsigned line_defined = 0;
+    size_t   instructions = 0;
+    double   seconds      = 0;
+};
+
+/*
+ * Counters and timings of decompiling one file. Counting an instruction is an increment
+ * and a compare, the parser only does it if it has metrics to fill.
+ */
+struct Metrics
+{
+    using Clock = std::chrono::steady_clock;
+
+    String                                   filename;
+    Status                                   status = Status::OK;
+    std::array<double, NUM_PHASES>           seconds{};
+    Vector<FunctionMetrics>                  functions;
+    std::array<size_t, size_t(1) << BITS_OP> operators{};
+    size_t                                   peak_stack = 0;
+    AstCount                                 nodes;
+
+    void count(Operator op, size_t stack_size)
+    {
+        operators[static_cast<size_t>(op)] += 1;
+        peak_stack = std::max(peak_stack, stack_size);
+    }
+
+    /*
+     * @brief   Adds the time since 'start' to the phase.
+     */
+    void add(Phase phase, Clock::time_point start)
+    {
+        seconds[static_cast<size_t>(phase)] +=
+            std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    size_t instructions() const;
+    double total_seconds() const;
+};
+
+/*
+ * Latencies of the calls of one handler. Bucket i counts the calls that took less than
+ * 2^i nanoseconds (and at least 2^(i-1)), the last bucket also the longer ones.
+ */
+struct HandlerHistogram
+{
+    static constexpr size_t NUM_BUCKETS = 32;
+
+    std::array<uint64_t, NUM_BUCKETS> buckets{};
+    uint64_t                          calls       = 0;
+    uint64_t                          nanoseconds = 0;
+    uint64_t                          max         = 0;
+
+    /*
+     * @brief   Upper bound of the bucket that holds the given fraction of the calls, at
+     *          most the longest call.
+     */
+    uint64_t percentile(double fraction) const;
+};
+
+/*
+ * Time spent in the handler of each operator. The time of a CLOSURE does not include the
+ * nested function, its instructions are recorded on their own. Reading the clock twice
+ * per instruction makes parsing slower, so the parser only times the handlers if it has a
+ * profile to fill. A profile is filled by one thread and merged into the profile of a
+ * batch, which any thread can do.
+ */
+class HandlerProfile
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    HandlerProfile()                                 = default;
+    HandlerProfile(const HandlerProfile&)            = delete;
+    HandlerProfile& operator=(const HandlerProfile&) = delete;
+
+    /*
+     * @brief   Records a call of the handler of 'op' without the time that was excluded
+     *          since the last call.
+     */
+    void record(Operator op, Clock::duration duration)
+    {
+        duration -= std::min(duration, m_excluded);
+        m_excluded = Clock::duration::zero();
+
+        const auto nanoseconds = uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+
+        size_t bucket = 0;
+        while(bucket + 1 < HandlerHistogram::NUM_BUCKETS && nanoseconds >> bucket != 0)
+            bucket += 1;
+
+        auto& histogram = m_operators[static_cast<size_t>(op)];
+        histogram.buckets[bucket] += 1;
+        histogram.calls += 1;
+        histogram.nanoseconds += nanoseconds;
+        histogram.max = std::max(histogram.max, nanoseconds);
+    }
+
+    /*
+     * @brief   Time of the current call that was spent in a nested function.
+     */
+    void exclude(Clock::duration duration)
+    {
+        m_excluded += duration;
+    }
+
+    void merge(const HandlerProfile& other);
+
+    /*
+     * @brief   Prints a table of the operators, the most expensive first, followed by the
+     *          histogram of each one.
+     */
+    void print(FILE* stream) const;
+
+private:
+    std::array<HandlerHistogram, size_t(1) << BITS_OP> m_operators;
+    Clock::duration                                    m_excluded{};
+    mutable std::mutex                                 m_mutex;
+};
+
+/*
+ * Spans of a decompilation run in the Trace Event Format, which trace viewers (Perfetto,
+ * chrome://tracing) show as one timeline per thread. A span is recorded when it ends,
+ * spans of one thread nest by their times. Threads can record at the same time.
+ */
+class Tracer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Tracer();
+    Tracer(const Tracer&)            = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /*
+     * @brief   Records a span of the calling thread from 'start' until now. 'args' are the
+     *          members of a JSON object, for example "\"line_defined\": 3".
+     */
+    void span(StringView name, Clock::time_point start, String args = {});
+
+    size_t size() const;
+    bool   write(const char* filename) const;
+
+private:
+    struct Event
+    {
+        String   name;
+        String   args;
+        unsigned thread;
+        double   start;  // microseconds since the tracer was created
+        double   duration;
+    };
+
+    Clock::time_point                             m_start;
+    mutable std::mutex                            m_mutex;
+    Vector<Event>                                 m_events;
+    std::unordered_map<std::thread::id, unsigned> m_threads;
+};
+
+/*
+ * @brief   The text as a JSON string, with quotes.
+ */
+String json_string(StringView text);
+
+/*
+ * @brief   Writes the metrics of the files as JSON. Files are sorted by their total time,
+ *          the slowest first, and followed by the sums over all files.
+ */
+bool write_metrics(const char* filename, const Vector<Metrics>& files);
+
+#endif  // LUA4DEC_METRICS_H
@@ -13,7 +13,6 @@ void State::print()
         {i++, "Condition"},
         {i++, "ForLoop"},
         {i++, "ForInLoop"},
-        {i++, "ForInLoop"},
         {i++, "LocalDefinition"},
         {i++, "Return"},
         {i++, "TailCall"},
@@ -45,74 +44,79 @@ void State::print()
         {
         case 0:
         {
-            auto statement = std::get<Statement>(el);
-            printf("%s\n", STATEMENT_VARIANTS.at(el.index()).c_str());
+            const auto& statement = (*arena)[std::get<Statement>(el)];
+            printf("%s\n", STATEMENT_VARIANTS.at(statement.index()).c_str());
             break;
         }
         case 1:
         {
-            auto expression = std::get<Expression>(el);
-            printf("%s\n", EXPRESSION_VARIANTS.at(el.index()).c_str());
+            const auto& expression = (*arena)[std::get<Expression>(el)];
+            printf("%s\n", EXPRESSION_VARIANTS.at(expression.index()).c_str());
             break;
         }
         }
     }
 }
 
-Status handle_condition(State&, Ast*&, const Instruction&, const Function&);
-
-Status handle_end(State&, Ast*&, const Instruction&, const Function&);
-Status handle_return(State&, Ast*&, const Instruction&, const Function&);
-Status handle_call(State&, Ast*&, const Instruction&, const Function&);
-Status handle_tail_call(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_nil(State&, Ast*&, const Instruction&, const Function&);
-Status handle_pop(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_int(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_string(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_num(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_neg_num(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_upvalue(State&, Ast*&, const Instruction&, const Function&);
-Status handle_get_local(State&, Ast*&, const Instruction&, const Function&);
-Status handle_get_global(State&, Ast*&, const Instruction&, const Function&);
-Status handle_get_table(State&, Ast*&, const Instruction&, const Function&);
-Status handle_get_dotted(State&, Ast*&, const Instruction&, const Function&);
-Status handle_get_indexed(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_self(State&, Ast*&, const Instruction&, const Function&);
-Status handle_create_table(State&, Ast*&, const Instruction&, const Function&);
-Status handle_set_local(State&, Ast*&, const Instruction&, const Function&);
-Status handle_set_global(State&, Ast*&, const Instruction&, const Function&);
-Status handle_set_table(State&, Ast*&, const Instruction&, const Function&);
-Status handle_set_list(State&, Ast*&, const Instruction&, const Function&);
-Status handle_set_map(State&, Ast*&, const Instruction&, const Function&);
-Status handle_add(State&, Ast*&, const Instruction&, const Function&);
-Status handle_addi(State&, Ast*&, const Instruction&, const Function&);
-Status handle_sub(State&, Ast*&, const Instruction&, const Function&);
-Status handle_mult(State&, Ast*&, const Instruction&, const Function&);
-Status handle_div(State&, Ast*&, const Instruction&, const Function&);
-Status handle_pow(State&, Ast*&, const Instruction&, const Function&);
-Status handle_concat(State&, Ast*&, const Instruction&, const Function&);
-Status handle_minus(State&, Ast*&, const Instruction&, const Function&);
-Status handle_not(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpne(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpeq(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmplt(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmple(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpgt(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpge(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpt(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpf(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmpont(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmponf(State&, Ast*&, const Instruction&, const Function&);
-Status handle_jmp(State&, Ast*&, const Instruction&, const Function&);
-Status handle_push_niljump(State&, Ast*&, const Instruction&, const Function&);
-Status handle_forprep(State&, Ast*&, const Instruction&, const Function&);
-Status handle_lforprep(State&, Ast*&, const Instruction&, const Function&);
-Status handle_forloop(State&, Ast*&, const Instruction&, const Function&);
-Status handle_lforloop(State&, Ast*&, const Instruction&, const Function&);
-Status handle_closure(State&, Ast*&, const Instruction&, const Function&);
+Status handle_condition(State&, Ast*&, const Code&, const Function&);
+
+Status handle_end(State&, Ast*&, const Code&, const Function&);
+Status handle_return(State&, Ast*&, const Code&, const Function&);
+Status handle_call(State&, Ast*&, const Code&, const Function&);
+Status handle_tail_call(State&, Ast*&, const Code&, const Function&);
+Status handle_push_nil(State&, Ast*&, const Code&, const Function&);
+Status handle_pop(State&, Ast*&, const Code&, const Function&);
+Status handle_push_int(State&, Ast*&, const Code&, const Function&);
+Status handle_push_string(State&, Ast*&, const Code&, const Function&);
+Status handle_push_num(State&, Ast*&, const Code&, const Function&);
+Status handle_push_neg_num(State&, Ast*&, const Code&, const Function&);
+Status handle_push_upvalue(State&, Ast*&, const Code&, const Function&);
+Status handle_get_local(State&, Ast*&, const Code&, const Function&);
+Status handle_get_global(State&, Ast*&, const Code&, const Function&);
+Status handle_get_table(State&, Ast*&, const Code&, const Function&);
+Status handle_get_dotted(State&, Ast*&, const Code&, const Function&);
+Status handle_get_indexed(State&, Ast*&, const Code&, const Function&);
+Status handle_push_self(State&, Ast*&, const Code&, const Function&);
+Status handle_create_table(State&, Ast*&, const Code&, const Function&);
+Status handle_set_local(State&, Ast*&, const Code&, const Function&);
+Status handle_set_global(State&, Ast*&, const Code&, const Function&);
+Status handle_set_table(State&, Ast*&, const Code&, const Function&);
+Status handle_set_list(State&, Ast*&, const Code&, const Function&);
+Status handle_set_map(State&, Ast*&, const Code&, const Function&);
+Status handle_add(State&, Ast*&, const Code&, const Function&);
+Status handle_addi(State&, Ast*&, const Code&, const Function&);
+Status handle_sub(State&, Ast*&, const Code&, const Function&);
+Status handle_mult(State&, Ast*&, const Code&, const Function&);
+Status handle_div(State&, Ast*&, const Code&, const Function&);
+Status handle_pow(State&, Ast*&, const Code&, const Function&);
+Status handle_concat(State&, Ast*&, const Code&, const Function&);
+Status handle_minus(State&, Ast*&, const Code&, const Function&);
+Status handle_not(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpne(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpeq(State&, Ast*&, const Code&, const Function&);
+Status handle_jmplt(State&, Ast*&, const Code&, const Function&);
+Status handle_jmple(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpgt(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpge(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpt(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpf(State&, Ast*&, const Code&, const Function&);
+Status handle_jmpont(State&, Ast*&, const Code&, const Function&);
+Status handle_jmponf(State&, Ast*&, const Code&, const Function&);
+Status handle_jmp(State&, Ast*&, const Code&, const Function&);
+Status handle_push_niljump(State&, Ast*&, const Code&, const Function&);
+Status handle_forprep(State&, Ast*&, const Code&, const Function&);
+Status handle_lforprep(State&, Ast*&, const Code&, const Function&);
+Status handle_forloop(State&, Ast*&, const Code&, const Function&);
+Status handle_lforloop(State&, Ast*&, const Code&, const Function&);
+Status handle_closure(State&, Ast*&, const Code&, const Function&);
+
+Status handle_undefined(State&, Ast*&, const Code&, const Function&);
+
+Status parse_block(State&, Ast*&, const Function&);
+Status parse_measured(State&, Ast*&, const Function&);
 
 // clang-format off
-auto TABLE = ActionTable
+constexpr std::pair<Operator, Action> ACTIONS[] =
 {
     {Operator::END,         &handle_end},
     {Operator::RETURN,      &handle_return},
@@ -164,20 +168,71 @@ auto TABLE = ActionTable
     {Operator::LFORLOOP,    &handle_lforloop},
     {Operator::CLOSURE,     &handle_closure},
 };
-
 // clang-format on
 
+/*
+ * The operator is used as index into the table. Operators without a parsing function
+ * (all values of the operator bits above CLOSURE) are mapped to handle_undefined.
+ */
+constexpr ActionTable make_action_table()
+{
+    ActionTable table{};
+
+    for(auto& action : table)
+        action = &handle_undefined;
+
+    for(const auto& [op, action] : ACTIONS)
+        table[static_cast<size_t>(op)] = action;
+
+    return table;
+}
+
+constexpr ActionTable TABLE = make_action_table();
+
 /*
  * Helper functions
  */
 
-Status enter_block(State& state, Ast*& ast)
+/*
+ * @brief   A new identifier node.
+ */
+Expression identifier(AstArena& arena, StringView name)
+{
+    return arena.expression(Identifier(arena.text(name)));
+}
+
+/*
+ * @brief   The condition that the current block belongs to. A malformed jump can end a
+ *          block that is not part of a condition, then there is none.
+ */
+Condition* parent_condition(State& state, Ast* ast)
 {
-    auto* child   = new Ast();
-    child->parent = ast;
+    auto* parent = state.arena->parent(ast);
+    if(parent == nullptr || parent->statements.empty())
+        return nullptr;
 
-    ast->child = child;
-    ast        = child;
+    return std::get_if<Condition>(&(*state.arena)[parent->statements.back()]);
+}
+
+/*
+ * @brief   Stores the statements of the current block in the last block of the condition,
+ *          after an else block was added if the last jump operator was a JMP.
+ */
+void close_condition_block(State& state, Ast* ast, Condition& condition)
+{
+    auto& arena = *state.arena;
+
+    if(ast->context.is_jmp_block)
+        arena.append(condition.blocks, ConditionBlock(AstOperation("", {}), {}));
+
+    const auto statements = arena.list(ast->statements);
+    arena.items(condition.blocks).back().statements = statements;
+    ast->statements.clear();
+}
+
+Status enter_block(State& state, Ast*& ast)
+{
+    ast = state.arena->add_child(ast);
 
     state.scope_level += 1;
 
@@ -186,8 +241,8 @@ Status enter_block(State& state, Ast*& ast)
 
 Status exit_block(State& state, Ast*& ast)
 {
-    if(ast->parent)
-        ast = ast->parent;
+    if(auto* parent = state.arena->parent(ast))
+        ast = parent;
 
     state.scope_level -= 1;
 
@@ -199,33 +254,34 @@ Status exit_block(State& state, Ast*& ast)
  *          The operation determines how the arguments are handled.
  */
 Status handle_condition(
-    State&                    state,
-    Ast*&                     ast,
-    const Instruction&        instruction,
-    const String&             comparison,
-    const Vector<Expression>& operands)
+    State&      state,
+    Ast*&       ast,
+    const Code& code,
+    StringView  comparison,
+    Expressions operands)
 {
+    auto& arena = *state.arena;
+
     // if block
     if(!ast->context.is_condition || ast->context.jmp_offset == 0)
     {
-        const auto operation = AstOperation(comparison, operands);
-        const auto block     = ConditionBlock(operation, {});
-        const auto condition = Condition({block});
-        ast->statements.push_back(condition);
+        const auto block = ConditionBlock(AstOperation(comparison, operands), {});
+        ast->statements.push_back(arena.statement(Condition(arena.list({block}))));
 
         enter_block(state, ast);
         ast->context.is_condition = true;
-        ast->context.jump_offset  = state.PC + S(instruction);
+        ast->context.jump_offset  = state.PC + code.s[state.PC];
     }
     // elseif block
     else
     {
-        auto&      condition = std::get<Condition>(ast->parent->statements.back());
-        const auto operation = AstOperation(comparison, operands);
-        const auto block     = ConditionBlock(operation, {});
-        condition.blocks.push_back(block);
+        auto* condition = parent_condition(state, ast);
+        if(condition == nullptr)
+            return Status::BAD_VARIANT;
+
+        arena.append(condition->blocks, ConditionBlock(AstOperation(comparison, operands), {}));
 
-        ast->context.jump_offset = state.PC + S(instruction);
+        ast->context.jump_offset = state.PC + code.s[state.PC];
     }
     ast->context.is_jmp_block = false;
 
@@ -240,8 +296,10 @@ Status handle_condition(
  * to be kept track of how many values are actually on the right side. The values have to
  * be 'adjusted' when reassembling the statement.
  */
-Status handle_assignment(State& state, Ast*& ast, const Identifier& left)
+Status handle_assignment(State& state, Ast*& ast, Expression left)
 {
+    auto& arena = *state.arena;
+
     auto values_on_stack = state.stack.size() - state.reserved_elements;
     if(values_on_stack > 0)
     {
@@ -249,21 +307,22 @@ Status handle_assignment(State& state, Ast*& ast, const Identifier& left)
         Vector<Expression> values;
         while(values_on_stack > 0)
         {
-            values.push_back(std::get<Expression>(state.stack.back()));
-            state.stack.pop_back();
+            values.push_back(state.stack.pop_expression());
             --values_on_stack;
         }
 
-        Assignment ass({left}, values, 1, values.size());
-        ast->statements.push_back(ass);
+        const auto num_values = unsigned(values.size());
+        ast->statements.push_back(
+            arena.statement(Assignment(arena.list({left}), arena.list(values), 1, num_values)));
     }
     else
     {
         // A function call with multiple return values represents the right.
-        if(std::holds_alternative<Assignment>(ast->statements.back()))
+        if(!ast->statements.empty() &&
+           std::holds_alternative<Assignment>(arena[ast->statements.back()]))
         {
-            auto& ass = std::get<Assignment>(ast->statements.back());
-            ass.left.push_back(left);
+            auto& ass = std::get<Assignment>(arena[ast->statements.back()]);
+            arena.append(ass.left, left);
         }
         else
         {
@@ -278,6 +337,14 @@ Status handle_assignment(State& state, Ast*& ast, const Identifier& left)
  * Parsing functions
  */
 
+/*
+ * @brief   The operator bits do not encode a lua 4 operator.
+ */
+Status handle_undefined(State&, Ast*&, const Code&, const Function&)
+{
+    return Status::UNDEFINED;
+}
+
 /*
  * Arguments:       -
  * Stack before:    -
@@ -286,7 +353,7 @@ Status handle_assignment(State& state, Ast*& ast, const Identifier& left)
  *
  * @brief   Operator has no effect and is handled implicitly by the other operators.
  */
-Status handle_end(State&, Ast*&, const Instruction&, const Function&)
+Status handle_end(State&, Ast*&, const Code&, const Function&)
 {
     return Status::OK;
 }
@@ -300,21 +367,20 @@ Status handle_end(State&, Ast*&, const Instruction&, const Function&)
  * @brief   Pops elements from the stack until it has a size of 'U'. The popped elements
  *          are returned in reverse order.
  */
-Status handle_return(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_return(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    auto u = U(instruction);  // U marks the position of the arguments
+    auto u = code.u[state.PC];  // U marks the position of the arguments
 
     Vector<Expression> args;
     while(state.stack.size() > u)
     {
-        args.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        args.push_back(state.stack.pop_expression());
     }
 
     std::reverse(args.begin(), args.end());
 
-    Return ret(args);
-    ast->statements.push_back(ret);
+    auto& arena = *state.arena;
+    ast->statements.push_back(arena.statement(Return(arena.list(args))));
 
     return Status::OK;
 }
@@ -331,35 +397,34 @@ Status handle_return(State& state, Ast*& ast, const Instruction& instruction, co
  *          In case the caller is a table or a map (both of type AstTable) we just push
  *          it back onto the stack.
  */
-Status handle_call(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_call(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto a = A(instruction);  // The caller is at position a
-    const auto b = B(instruction);  // > 0 if it is an expression call returning b
+    const auto a = code.a[state.PC];  // The caller is at position a
+    const auto b = code.b[state.PC];  // > 0 if it is an expression call returning b
                                     // arguments.
 
     Vector<Expression> args;
     while(state.stack.size() > a + 1)
     {
-        args.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        args.push_back(state.stack.pop_expression());
     }
 
-    auto caller = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto& arena  = *state.arena;
+    auto  caller = state.stack.pop_expression();
 
-    if(std::holds_alternative<AstTable>(caller))
+    if(std::holds_alternative<AstTable>(arena[caller]))
     {
-        auto table = std::get<AstTable>(caller);
-        state.stack.push_back(table);
+        state.stack.push_back(caller);
     }
     else
     {
         std::reverse(args.begin(), args.end());
 
+        const auto call = Call(arena.list({caller}), arena.list(args), b);
         if(b == 0)
-            ast->statements.push_back(Call({caller}, args));
+            ast->statements.push_back(arena.statement(call));
         else
-            state.stack.push_back(Expression(Call({caller}, args, b)));
+            state.stack.push_back(arena.expression(call));
     }
 
     return Status::OK;
@@ -377,23 +442,22 @@ Status handle_call(State& state, Ast*& ast, const Instruction& instruction, cons
  *          elements are the arguments in reversed order. The value of the function is
  *          returned from the current closure.
  */
-Status handle_tail_call(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_tail_call(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto a = A(instruction);  // The caller is at position a
+    const auto a = code.a[state.PC];  // The caller is at position a
 
     Vector<Expression> args;
     while(state.stack.size() > a + 1)
     {
-        args.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        args.push_back(state.stack.pop_expression());
     }
 
-    auto caller = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto caller = state.stack.pop_expression();
 
     std::reverse(args.begin(), args.end());
 
-    ast->statements.push_back(TailCall({caller}, args));
+    auto& arena = *state.arena;
+    ast->statements.push_back(arena.statement(TailCall(arena.list({caller}), arena.list(args))));
 
     return Status::OK;
 }
@@ -406,13 +470,13 @@ Status handle_tail_call(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief   Pushes one or multiple nil values on to the stack.
  */
-Status handle_push_nil(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_push_nil(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    auto u = U(instruction);
+    auto u = code.u[state.PC];
 
     for(auto i = u; i > 0; --i)
     {
-        state.stack.push_back(Identifier("nil"));
+        state.stack.push_back(identifier(*state.arena, "nil"));
     }
 
     return Status::OK;
@@ -426,9 +490,9 @@ Status handle_push_nil(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief   Pops one or multiple values from the stack.
  */
-Status handle_pop(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_pop(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    auto u = U(instruction);
+    auto u = code.u[state.PC];
 
     for(auto i = u; i > 0; --i)
     {
@@ -446,11 +510,11 @@ Status handle_pop(State& state, Ast*& ast, const Instruction& instruction, const
  *
  * @brief
  */
-Status handle_push_int(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_push_int(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto s = S(instruction);
+    const auto s = code.s[state.PC];
 
-    state.stack.push_back(AstInt(s));
+    state.stack.push_back(state.arena->expression(AstInt(s)));
 
     return Status::OK;
 }
@@ -463,12 +527,13 @@ Status handle_push_int(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief
  */
-Status handle_push_string(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_push_string(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto k      = U(instruction);
+    const auto k      = code.u[state.PC];
     const auto string = function.globals[k];
 
-    state.stack.push_back(AstString(string));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstString(arena.text(string))));
 
     return Status::OK;
 }
@@ -481,12 +546,12 @@ Status handle_push_string(State& state, Ast*& ast, const Instruction& instructio
  *
  * @brief
  */
-Status handle_push_num(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_push_num(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto n      = U(instruction);
+    const auto n      = code.u[state.PC];
     const auto number = function.numbers[n];
 
-    state.stack.push_back(AstNumber(number));
+    state.stack.push_back(state.arena->expression(AstNumber(number)));
 
     return Status::OK;
 }
@@ -499,12 +564,12 @@ Status handle_push_num(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief
  */
-Status handle_push_neg_num(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_push_neg_num(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto n      = U(instruction);
+    const auto n      = code.u[state.PC];
     const auto number = function.numbers[n];
 
-    state.stack.push_back(AstNumber(-number));
+    state.stack.push_back(state.arena->expression(AstNumber(-number)));
 
     return Status::OK;
 }
@@ -517,7 +582,7 @@ Status handle_push_neg_num(State& state, Ast*& ast, const Instruction& instructi
  *
  * @brief
  */
-Status handle_push_upvalue(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_push_upvalue(State& state, Ast*& ast, const Code& code, const Function& function)
 {
     // TODO
     return Status::OK;
@@ -529,26 +594,18 @@ Status handle_push_upvalue(State& state, Ast*& ast, const Instruction& instructi
  * Stack after:     LOC[l]
  * Side effects:    -
  *
- * @brief   Pushes the l-th valid local onto the stack. The index of the local has to
- *          be normalized according to the validity range.
+ * @brief   Pushes the l-th valid local onto the stack. The index of the local is the
+ *          slot among the locals that are alive at the current PC.
  */
-Status handle_get_local(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_get_local(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    auto l = U(instruction);
+    const auto l = code.u[state.PC];
+    if(!state.locals.has(l))
+        return Status::UNDEFINED;
 
-    auto index = 0;
-    auto i     = 0;
-    while(i != l)
-    {
-        if(function.locals[index].start_pc <= state.PC &&
-           function.locals[index].end_pc >= state.PC)
-            i++;
-        index++;
-    }
+    const auto name = function.locals[state.locals.local(l)].name;
 
-    auto name = function.locals[index].name;
-
-    state.stack.push_back(Identifier(name));
+    state.stack.push_back(identifier(*state.arena, name));
 
     return Status::OK;
 }
@@ -561,12 +618,12 @@ Status handle_get_local(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief
  */
-Status handle_get_global(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_get_global(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto k    = U(instruction);
+    const auto k    = code.u[state.PC];
     const auto name = function.globals[k];
 
-    state.stack.push_back(Identifier(name));
+    state.stack.push_back(identifier(*state.arena, name));
 
     return Status::OK;
 }
@@ -579,17 +636,16 @@ Status handle_get_global(State& state, Ast*& ast, const Instruction& instruction
  *
  * @brief
  */
-Status handle_get_table(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_get_table(State& state, Ast*& ast, const Code&, const Function&)
 {
     // i
-    const auto index = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto index = state.stack.pop_expression();
 
     // t
-    const auto table = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto table = state.stack.pop_expression();
 
-    state.stack.push_back(Indexed({table, index}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(Indexed(arena.list({table, index}))));
 
     return Status::OK;
 }
@@ -602,16 +658,17 @@ Status handle_get_table(State& state, Ast*& ast, const Instruction&, const Funct
  *
  * @brief
  */
-Status handle_get_dotted(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_get_dotted(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto k    = U(instruction);
+    const auto k    = code.u[state.PC];
     const auto name = function.globals[k];
 
     // t
-    const auto table = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto& arena = *state.arena;
+    auto  table = state.stack.pop_expression();
+    auto  key   = identifier(arena, name);
 
-    state.stack.push_back(Dotted({table, Identifier(name)}));
+    state.stack.push_back(arena.expression(Dotted(arena.list({table, key}))));
 
     return Status::OK;
 }
@@ -624,16 +681,20 @@ Status handle_get_dotted(State& state, Ast*& ast, const Instruction& instruction
  *
  * @brief
  */
-Status handle_get_indexed(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_get_indexed(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto l    = U(instruction);
-    const auto name = function.locals[l].name;
+    const auto l = code.u[state.PC];
+    if(!state.locals.has(l))
+        return Status::UNDEFINED;
+
+    const auto name = function.locals[state.locals.local(l)].name;
 
     // t
-    const auto table = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto& arena = *state.arena;
+    auto  table = state.stack.pop_expression();
+    auto  key   = identifier(arena, name);
 
-    state.stack.push_back(Indexed({table, Identifier(name)}));
+    state.stack.push_back(arena.expression(Indexed(arena.list({table, key}))));
 
     return Status::OK;
 }
@@ -646,14 +707,17 @@ Status handle_get_indexed(State& state, Ast*& ast, const Instruction& instructio
  *
  * @brief
  */
-Status handle_push_self(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_push_self(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto k    = U(instruction);
+    const auto k    = code.u[state.PC];
     const auto name = function.globals[k];
 
-    // t
-    const auto table = std::get<Expression>(state.stack.back());
-    state.stack.push_back(Dotted({table, Identifier(name)}));
+    // t, which stays on the stack and is copied into the method
+    auto& arena = *state.arena;
+    auto  table = arena.copy(arena, std::get<Expression>(state.stack.back()));
+    auto  key   = identifier(arena, name);
+
+    state.stack.push_back(arena.expression(Dotted(arena.list({table, key}))));
 
     return Status::OK;
 }
@@ -666,15 +730,17 @@ Status handle_push_self(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief   Creates a new table element (may be list or map) of the given size.
  */
-Status handle_create_table(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_create_table(State& state, Ast*& ast, const Code& code, const Function& function)
 {
     // Its only a table if an identifier is on the stack before. Otherwise its a map or
     // list.
 
-    std::string name;
+    auto& arena = *state.arena;
+
+    AstText name;
     if(state.stack.size() > state.reserved_elements)
     {
-        const auto ex = std::get<Expression>(state.stack.back());
+        const auto& ex = arena[std::get<Expression>(state.stack.back())];
         if(std::holds_alternative<Identifier>(ex))
         {
             name = std::get<Identifier>(ex).name;
@@ -682,9 +748,8 @@ Status handle_create_table(State& state, Ast*& ast, const Instruction& instructi
         }
     }
 
-    const auto u = U(instruction);
-    AstTable   table(u, name, {});
-    state.stack.push_back(table);
+    const auto u = code.u[state.PC];
+    state.stack.push_back(arena.expression(AstTable(u, name, {})));
 
     return Status::OK;
 }
@@ -697,10 +762,13 @@ Status handle_create_table(State& state, Ast*& ast, const Instruction& instructi
  *
  * @brief   Sets the local variable at position l to the top-most value on the stack.
  */
-Status handle_set_local(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_set_local(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto l    = U(instruction);
-    const auto left = Identifier(function.locals[l].name);
+    const auto l = code.u[state.PC];
+    if(!state.locals.has(l))
+        return Status::UNDEFINED;
+
+    const auto left = identifier(*state.arena, function.locals[state.locals.local(l)].name);
 
     return handle_assignment(state, ast, left);
 }
@@ -713,10 +781,10 @@ Status handle_set_local(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief   Creates an assignment statement.
  */
-Status handle_set_global(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_set_global(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto k    = U(instruction);
-    const auto left = Identifier(function.globals[k]);
+    const auto k    = code.u[state.PC];
+    const auto left = identifier(*state.arena, function.globals[k]);
 
     return handle_assignment(state, ast, left);
 }
@@ -729,35 +797,37 @@ Status handle_set_global(State& state, Ast*& ast, const Instruction& instruction
  *
  * @brief   Creates a table assignment with b table elements.
  */
-Status handle_set_table(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_set_table(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto b = B(instruction);
+    const auto b = code.b[state.PC];
 
     Vector<Expression> args;
     for(unsigned i = 0; i < b; ++i)
     {
-        args.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        args.push_back(state.stack.pop_expression());
     }
 
     std::reverse(args.begin(), args.end());
 
+    auto& arena = *state.arena;
+
     std::string left;
     for(auto it = args.begin(); it != args.end() - 1; ++it)
     {
-        if(std::holds_alternative<Identifier>(*it))
-            left.append(std::get<Identifier>(*it).name);
-        else if(std::holds_alternative<AstString>(*it))
-            left.append(std::get<AstString>(*it).value);
+        const auto& ex = arena[*it];
+        if(std::holds_alternative<Identifier>(ex))
+            left.append(arena.text(std::get<Identifier>(ex).name));
+        else if(std::holds_alternative<AstString>(ex))
+            left.append(arena.text(std::get<AstString>(ex).value));
 
         if(it != args.end() - 2)
             left.append(".");
     }
 
-    const auto right = args.back();
-
-    Assignment ass({Identifier(left)}, {right});
-    ast->statements.push_back(ass);
+    const auto variable = identifier(arena, left);
+    const auto value    = args.back();
+    ast->statements.push_back(
+        arena.statement(Assignment(arena.list({variable}), arena.list({value}))));
 
     return Status::OK;
 }
@@ -770,21 +840,21 @@ Status handle_set_table(State& state, Ast*& ast, const Instruction& instruction,
  *
  * @brief   Creates a list of b elements that is pushed onto the stack.
  */
-Status handle_set_list(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_set_list(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto b = B(instruction);
+    const auto b = code.b[state.PC];
 
     Vector<Expression> list;
     for(unsigned i = 0; i < b; ++i)
     {
-        list.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        list.push_back(state.stack.pop_expression());
     }
 
     std::reverse(list.begin(), list.end());
 
+    auto& arena = *state.arena;
     state.stack.pop_back();  // empty AstTable
-    state.stack.push_back(AstList(list));
+    state.stack.push_back(arena.expression(AstList(arena.list(list))));
 
     return Status::OK;
 }
@@ -799,33 +869,32 @@ Status handle_set_list(State& state, Ast*& ast, const Instruction& instruction,
  *          was created before. Otherwise a map of this size is created and pushed
  *          onto the stack.
  */
-Status handle_set_map(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_set_map(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto u = U(instruction);
+    const auto u = code.u[state.PC];
 
-    Vector<std::pair<Expression, Expression>> map;
+    // Popped as value, key, value, key, ... and reversed into key, value, key, value, ...
+    Vector<Expression> map;
     for(unsigned i = 0; i < u; ++i)
     {
-        const auto value = std::get<Expression>(state.stack.back());
-        state.stack.pop_back();
-
-        const auto key = std::get<Expression>(state.stack.back());
-        state.stack.pop_back();
-
-        map.push_back(std::pair(key, value));
+        map.push_back(state.stack.pop_expression());
+        map.push_back(state.stack.pop_expression());
     }
 
     std::reverse(map.begin(), map.end());
 
-    auto& table = std::get<AstTable>(std::get<Expression>(state.stack.back()));
-    if(table.name.name.empty())
+    auto&      arena = *state.arena;
+    const auto pairs = arena.list(map);
+
+    auto& table = std::get<AstTable>(arena[std::get<Expression>(state.stack.back())]);
+    if(table.name.size == 0)
     {
         state.stack.pop_back();  // empty AstTable
-        state.stack.push_back(AstMap(map));
+        state.stack.push_back(arena.expression(AstMap(pairs)));
     }
     else
     {
-        table.pairs = map;
+        table.pairs = pairs;
     }
 
     return Status::OK;
@@ -839,15 +908,14 @@ Status handle_set_map(State& state, Ast*& ast, const Instruction& instruction, c
  *
  * @brief
  */
-Status handle_add(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_add(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("+", {left, right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("+", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -860,15 +928,15 @@ Status handle_add(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief
  */
-Status handle_addi(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_addi(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    const auto s     = S(instruction);
-    const auto right = AstNumber(s);
+    auto&      arena = *state.arena;
+    const auto s     = code.s[state.PC];
+    const auto right = arena.expression(AstNumber(s));
 
-    state.stack.push_back(AstOperation("+", {left, right}));
+    state.stack.push_back(arena.expression(AstOperation("+", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -881,15 +949,14 @@ Status handle_addi(State& state, Ast*& ast, const Instruction& instruction, cons
  *
  * @brief
  */
-Status handle_sub(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_sub(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("-", {left, right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("-", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -902,15 +969,14 @@ Status handle_sub(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief
  */
-Status handle_mult(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_mult(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("*", {left, right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("*", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -923,15 +989,14 @@ Status handle_mult(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief
  */
-Status handle_div(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_div(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("/", {left, right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("/", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -944,15 +1009,14 @@ Status handle_div(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief
  */
-Status handle_pow(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_pow(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("^", {left, right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("^", arena.list({left, right}))));
 
     return Status::OK;
 }
@@ -965,18 +1029,19 @@ Status handle_pow(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief   Concatenates u elements from the stack together.
  */
-Status handle_concat(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_concat(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto         u = U(instruction);
+    const auto         u = code.u[state.PC];
     Vector<Expression> expressions;
     for(unsigned i = 0; i < u; ++i)
     {
-        expressions.push_back(std::get<Expression>(state.stack.back()));
-        state.stack.pop_back();
+        expressions.push_back(state.stack.pop_expression());
     }
 
     std::reverse(expressions.begin(), expressions.end());
-    state.stack.push_back(AstOperation("..", expressions));
+
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("..", arena.list(expressions))));
 
     return Status::OK;
 }
@@ -989,12 +1054,12 @@ Status handle_concat(State& state, Ast*& ast, const Instruction& instruction, co
  *
  * @brief   Negates the numeric value of the top-most element on the stack.
  */
-Status handle_minus(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_minus(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("-", {right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("-", arena.list({right}))));
 
     return Status::OK;
 }
@@ -1007,12 +1072,12 @@ Status handle_minus(State& state, Ast*& ast, const Instruction&, const Function&
  *
  * @brief   Negates the truth value of the top-most element on the stack.
  */
-Status handle_not(State& state, Ast*& ast, const Instruction&, const Function&)
+Status handle_not(State& state, Ast*& ast, const Code&, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    state.stack.push_back(AstOperation("not ", {right}));
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("not ", arena.list({right}))));
 
     return Status::OK;
 }
@@ -1025,15 +1090,13 @@ Status handle_not(State& state, Ast*& ast, const Instruction&, const Function&)
  *
  * @brief
  */
-Status handle_jmpne(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpne(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, "==", {left, right});
+    return handle_condition(state, ast, code, "==", state.arena->list({left, right}));
 }
 
 /*
@@ -1044,15 +1107,13 @@ Status handle_jmpne(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmpeq(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpeq(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, "~=", {left, right});
+    return handle_condition(state, ast, code, "~=", state.arena->list({left, right}));
 }
 
 /*
@@ -1063,15 +1124,13 @@ Status handle_jmpeq(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmplt(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmplt(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, ">=", {left, right});
+    return handle_condition(state, ast, code, ">=", state.arena->list({left, right}));
 }
 
 /*
@@ -1082,15 +1141,13 @@ Status handle_jmplt(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmple(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmple(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, ">", {left, right});
+    return handle_condition(state, ast, code, ">", state.arena->list({left, right}));
 }
 
 /*
@@ -1101,15 +1158,13 @@ Status handle_jmple(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmpgt(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpgt(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, "<=", {left, right});
+    return handle_condition(state, ast, code, "<=", state.arena->list({left, right}));
 }
 
 /*
@@ -1120,15 +1175,13 @@ Status handle_jmpgt(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmpge(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpge(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
 
-    return handle_condition(state, ast, instruction, "<", {left, right});
+    return handle_condition(state, ast, code, "<", state.arena->list({left, right}));
 }
 
 /*
@@ -1139,12 +1192,13 @@ Status handle_jmpge(State& state, Ast*& ast, const Instruction& instruction, con
  *
  * @brief
  */
-Status handle_jmpt(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpt(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
+
+    auto nil = identifier(*state.arena, "nil");
 
-    return handle_condition(state, ast, instruction, "~=", {left, Identifier("nil")});
+    return handle_condition(state, ast, code, "~=", state.arena->list({left, nil}));
 }
 
 /*
@@ -1155,12 +1209,13 @@ Status handle_jmpt(State& state, Ast*& ast, const Instruction& instruction, cons
  *
  * @brief
  */
-Status handle_jmpf(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpf(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
+
+    auto nil = identifier(*state.arena, "nil");
 
-    return handle_condition(state, ast, instruction, "==", {left, Identifier("nil")});
+    return handle_condition(state, ast, code, "==", state.arena->list({left, nil}));
 }
 
 /*
@@ -1171,16 +1226,15 @@ Status handle_jmpf(State& state, Ast*& ast, const Instruction& instruction, cons
  *
  * @brief
  */
-Status handle_jmpont(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmpont(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    auto right = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto right = state.stack.pop_expression();
 
-    AstOperation operation("or", {right});
-    state.stack.push_back(operation);
+    auto& arena = *state.arena;
+    state.stack.push_back(arena.expression(AstOperation("or", arena.list({right}))));
 
     ast->context.is_or_block = true;
-    ast->context.jump_offset = state.PC + S(instruction);
+    ast->context.jump_offset = state.PC + code.s[state.PC];
 
     return Status::OK;
 }
@@ -1193,12 +1247,13 @@ Status handle_jmpont(State& state, Ast*& ast, const Instruction& instruction, co
  *
  * @brief
  */
-Status handle_jmponf(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmponf(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    const auto left = std::get<Expression>(state.stack.back());
-    state.stack.pop_back();
+    auto left = state.stack.pop_expression();
+
+    auto nil = identifier(*state.arena, "nil");
 
-    return handle_condition(state, ast, instruction, "==", {left, Identifier("nil")});
+    return handle_condition(state, ast, code, "==", state.arena->list({left, nil}));
 }
 
 /*
@@ -1209,22 +1264,15 @@ Status handle_jmponf(State& state, Ast*& ast, const Instruction& instruction, co
  *
  * @brief
  */
-Status handle_jmp(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_jmp(State& state, Ast*& ast, const Code& code, const Function&)
 {
     if(ast->context.is_condition && state.PC >= ast->context.jump_offset)
     {
-        auto& condition = std::get<Condition>(ast->parent->statements.back());
-
-        // Create an else block if the last jump operator was a JMP
-        if(ast->context.is_jmp_block)
-        {
-            const auto operation = AstOperation("", {});
-            const auto block     = ConditionBlock(operation, {});
-            condition.blocks.push_back(block);
-        }
+        auto* condition = parent_condition(state, ast);
+        if(condition == nullptr)
+            return Status::BAD_VARIANT;
 
-        condition.blocks.back().statements = ast->statements;
-        ast->statements.clear();
+        close_condition_block(state, ast, *condition);
 
         ast->context.is_condition = false;
         exit_block(state, ast);
@@ -1232,12 +1280,17 @@ Status handle_jmp(State& state, Ast*& ast, const Instruction& instruction, const
 
     if(ast->context.is_condition)
     {
-        auto& condition = std::get<Condition>(ast->parent->statements.back());
-        condition.blocks.back().statements = ast->statements;
+        auto* condition = parent_condition(state, ast);
+        if(condition == nullptr)
+            return Status::BAD_VARIANT;
+
+        auto& arena      = *state.arena;
+        auto  statements = arena.list(ast->statements);
+        arena.items(condition->blocks).back().statements = statements;
         ast->statements.clear();
 
-        ast->context.jump_offset  = state.PC + S(instruction);
-        ast->context.jmp_offset   = state.PC + S(instruction);
+        ast->context.jump_offset  = state.PC + code.s[state.PC];
+        ast->context.jmp_offset   = state.PC + code.s[state.PC];
         ast->context.is_jmp_block = true;
     }
 
@@ -1252,9 +1305,9 @@ Status handle_jmp(State& state, Ast*& ast, const Instruction& instruction, const
  *
  * @brief
  */
-Status handle_push_niljump(State& state, Ast*& ast, const Instruction& instruction, const Function&)
+Status handle_push_niljump(State& state, Ast*& ast, const Code& code, const Function&)
 {
-    state.stack.push_back(Identifier("nil"));
+    state.stack.push_back(identifier(*state.arena, "nil"));
     return Status::OK;
 }
 
@@ -1268,10 +1321,13 @@ Status handle_push_niljump(State& state, Ast*& ast, const Instruction& instructi
  *        Therefore, we declare placeholder values and assign the real values
  *        when we reach the end of the loop.
  */
-Status handle_forprep(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_forprep(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    ForLoop loop("", Identifier(""), Identifier(""), Identifier(""), {});
-    ast->statements.push_back(loop);
+    auto&      arena     = *state.arena;
+    const auto begin     = identifier(arena, "");
+    const auto end       = identifier(arena, "");
+    const auto increment = identifier(arena, "");
+    ast->statements.push_back(arena.statement(ForLoop({}, begin, end, increment, {})));
 
     enter_block(state, ast);
 
@@ -1288,13 +1344,14 @@ Status handle_forprep(State& state, Ast*& ast, const Instruction& instruction, c
  *        Therefore, we declare placeholder values and assign the real values
  *        when we reach the end of the loop.
  */
-Status handle_lforprep(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_lforprep(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    state.stack.push_back(Identifier(""));  // value
-    state.stack.push_back(Identifier(""));  // key
+    auto& arena = *state.arena;
+    state.stack.push_back(identifier(arena, ""));  // value
+    state.stack.push_back(identifier(arena, ""));  // key
 
-    ForInLoop loop("", "", Identifier(""), {});
-    ast->statements.push_back(loop);
+    const auto table = identifier(arena, "");
+    ast->statements.push_back(arena.statement(ForInLoop({}, {}, table, {})));
 
     enter_block(state, ast);
 
@@ -1311,20 +1368,42 @@ Status handle_lforprep(State& state, Ast*& ast, const Instruction& instruction,
  *        definitions (key, value, table) from the first statement (the local
  *        definition) and remove it from the statements.
  */
-Status handle_forloop(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_forloop(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto nested_statements = ast->statements;
-    const auto loop_variables    = std::get<LocalDefinition>(nested_statements.front());
+    auto& arena = *state.arena;
+
+    // The block of the loop stays in the arena after it is left.
+    auto& nested_statements = ast->statements;
+    if(nested_statements.empty())
+        return Status::BAD_VARIANT;
+
+    // counter = begin, end, increment
+    const auto& loop_variables = std::get<LocalDefinition>(arena[nested_statements.front()]);
+    const auto  left           = arena.items(loop_variables.left);
+    const auto  right          = arena.items(loop_variables.right);
+    if(left.empty() || right.size() < 3)
+        return Status::BAD_VARIANT;
+
+    const auto counter   = std::get<Identifier>(arena[left[0]]).name;
+    const auto begin     = right[0];
+    const auto end       = right[1];
+    const auto increment = right[2];
 
     exit_block(state, ast);
 
-    auto& loop     = std::get<ForLoop>(ast->statements.back());
-    loop.counter   = loop_variables.left[0].name;
-    loop.begin     = loop_variables.right[0];
-    loop.end       = loop_variables.right[1];
-    loop.increment = loop_variables.right[2];
-    loop.statements =
-        Vector<Statement>(nested_statements.begin() + 1, nested_statements.end());
+    if(ast->statements.empty())
+        return Status::BAD_VARIANT;
+
+    nested_statements.erase(nested_statements.begin());
+    const auto statements = arena.list(nested_statements);
+    nested_statements.clear();
+
+    auto& loop      = std::get<ForLoop>(arena[ast->statements.back()]);
+    loop.counter    = counter;
+    loop.begin      = begin;
+    loop.end        = end;
+    loop.increment  = increment;
+    loop.statements = statements;
 
     state.stack.pop_back();
     state.stack.pop_back();
@@ -1343,19 +1422,40 @@ Status handle_forloop(State& state, Ast*& ast, const Instruction& instruction, c
  *        definitions (key, value, table) from the first statement (the local
  *        definition) and remove it from the statements.
  */
-Status handle_lforloop(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_lforloop(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto nested_statements = ast->statements;
-    const auto loop_variables    = std::get<LocalDefinition>(nested_statements.front());
+    auto& arena = *state.arena;
+
+    // The block of the loop stays in the arena after it is left.
+    auto& nested_statements = ast->statements;
+    if(nested_statements.empty())
+        return Status::BAD_VARIANT;
+
+    // (table), key, value = table
+    const auto& loop_variables = std::get<LocalDefinition>(arena[nested_statements.front()]);
+    const auto  left           = arena.items(loop_variables.left);
+    const auto  right          = arena.items(loop_variables.right);
+    if(left.size() < 3 || right.empty())
+        return Status::BAD_VARIANT;
+
+    const auto table = right[0];
+    const auto key   = std::get<Identifier>(arena[left[1]]).name;
+    const auto value = std::get<Identifier>(arena[left[2]]).name;
 
     exit_block(state, ast);
 
-    auto& loop = std::get<ForInLoop>(ast->statements.back());
-    loop.table = loop_variables.right[0];
-    loop.key   = loop_variables.left[1].name;
-    loop.value = loop_variables.left[2].name;
-    loop.statements =
-        Vector<Statement>(nested_statements.begin() + 1, nested_statements.end());
+    if(ast->statements.empty())
+        return Status::BAD_VARIANT;
+
+    nested_statements.erase(nested_statements.begin());
+    const auto statements = arena.list(nested_statements);
+    nested_statements.clear();
+
+    auto& loop      = std::get<ForInLoop>(arena[ast->statements.back()]);
+    loop.table      = table;
+    loop.key        = key;
+    loop.value      = value;
+    loop.statements = statements;
 
     state.stack.pop_back();
     state.stack.pop_back();
@@ -1374,66 +1474,168 @@ Status handle_lforloop(State& state, Ast*& ast, const Instruction& instruction,
  *          chunk. The arguments of the closure are defined implicitly by the number of
  *          their PC start.
  */
-Status handle_closure(State& state, Ast*& ast, const Instruction& instruction, const Function& function)
+Status handle_closure(State& state, Ast*& ast, const Code& code, const Function& function)
 {
-    const auto a = A(instruction);
-
-    enter_block(state, ast);
-
-    // Each closure needs a new state.
-    auto new_state = State();
-    auto error     = parse_function(new_state, ast, function.functions[a]);
+    auto&       arena  = *state.arena;
+    const auto  a      = code.a[state.PC];
+    const auto& nested = function.functions[a];
 
     // Arguments of the closure have to be searched in the local table.
-    Vector<Identifier> arguments;
-    for(const auto& local : function.functions[a].locals)
+    Vector<Expression> names;
+    for(const auto& local : nested.locals)
     {
         // Locals that start from PC = 0 are closure arguments.
         if(local.start_pc == 0)
         {
-            arguments.push_back(Identifier(local.name));
+            names.push_back(identifier(arena, local.name));
+        }
+    }
+
+    const auto arguments = arena.list(names);
+
+    // The closure might already be parsed in the arena of its prototype.
+    if(state.prototypes)
+    {
+        const auto prototype = state.prototypes->find(&nested);
+        if(prototype != state.prototypes->end())
+        {
+            if(prototype->second.exception)
+                std::rethrow_exception(prototype->second.exception);
+
+            const auto& parsed     = prototype->second;
+            const auto  statements = arena.copy(parsed.arena, parsed.statements);
+            state.stack.push_back(arena.expression(Closure(statements, arguments)));
+
+            return prototype->second.status;
         }
     }
 
+    // A function that is identical to one that was parsed before is copied.
+    uint64_t hash = 0;
+    if(state.memo)
+    {
+        hash = state.hashes->at(&nested);
+
+        auto status     = Status::OK;
+        auto statements = Statements();
+        if(state.memo->find(hash, status, arena, statements))
+        {
+            state.stack.push_back(arena.expression(Closure(statements, arguments)));
+            return status;
+        }
+    }
+
+    enter_block(state, ast);
+
+    // Each closure needs a new state.
+    auto new_state       = State();
+    new_state.arena      = state.arena;
+    new_state.prototypes = state.prototypes;
+    new_state.memo       = state.memo;
+    new_state.hashes     = state.hashes;
+    new_state.metrics    = state.metrics;
+    new_state.tracer     = state.tracer;
+    new_state.profile    = state.profile;
+
+    const auto start = state.profile ? HandlerProfile::Clock::now()
+                                     : HandlerProfile::Clock::time_point();
+    auto       error = parse_measured(new_state, ast, nested);
+
+    // The instructions of the nested function are not part of this CLOSURE.
+    if(state.profile)
+        state.profile->exclude(HandlerProfile::Clock::now() - start);
+
     exit_block(state, ast);
 
-    state.stack.push_back(Closure(ast->child->statements, arguments));
+    auto&      block      = arena.child(ast)->statements;
+    const auto statements = arena.list(block);
+    block.clear();
+
+    if(state.memo)
+        state.memo->insert(hash, error, arena, statements);
+
+    state.stack.push_back(arena.expression(Closure(statements, arguments)));
 
     return error;
 }
 
-// Public functions
+/*
+ * @brief   Parses a nested function the same way handle_closure does, inside a block of
+ *          the arena of the prototype.
+ */
+void parse_prototype(
+    Prototype&        prototype,
+    const Function&   function,
+    const Prototypes& prototypes,
+    const State&      parent)
+{
+    try
+    {
+        auto& arena = prototype.arena;
+        auto* ast   = arena.root();
+        auto  state = State();
+
+        state.arena      = &arena;
+        state.prototypes = &prototypes;
+        state.memo       = parent.memo;
+        state.hashes     = parent.hashes;
+
+        enter_block(state, ast);
+        prototype.status = parse_block(state, ast, function);
+        exit_block(state, ast);
+
+        auto& block          = arena.child(ast)->statements;
+        prototype.statements = arena.list(block);
+        block.clear();
+    }
+    catch(...)
+    {
+        prototype.exception = std::current_exception();
+    }
+}
+
+/*
+ * @brief   Prints the first 'count' statements and removes them from the block. Their
+ *          nodes stay in the arena until it is compacted.
+ */
+void emit_statements(
+    StringBuffer&      output,
+    const AstArena&    arena,
+    Vector<Statement>& statements,
+    size_t             count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        print_statement(arena, statements[i], output, 0);
+        output << "\n";
+    }
+
+    statements.erase(statements.begin(), statements.begin() + count);
+}
 
-Status parse_function(State& state, Ast*& ast, const Function& function)
+/*
+ * @brief   Runs the parsing function of every instruction.
+ */
+Status parse_instructions(State& state, Ast*& ast, const Function& function)
 {
-    // Lookup table for locals based on their starting lifetime.
-    std::unordered_map<unsigned, Vector<unsigned>> local_spawn;
-    std::unordered_map<unsigned, Vector<unsigned>> local_kill;
+    const auto& code  = function.code;
+    auto&       arena = *state.arena;
+
+    // The scope also looks up the locals by their starting and ending lifetime.
+    state.locals = LocalScope(function);
 
-    unsigned local_index = 0;
     for(const auto& local : function.locals)
     {
         if(local.start_pc == 0)
         {
-            state.stack.push_back(Identifier(local.name));
+            state.stack.push_back(identifier(arena, local.name));
             state.reserved_elements += 1;
         }
-
-        if(local_spawn.count(local.start_pc) == 0)
-            local_spawn[local.start_pc] = {};
-
-        if(local_kill.count(local.end_pc) == 0)
-            local_kill[local.end_pc] = {};
-
-        local_spawn[local.start_pc].push_back(local_index);
-        local_kill[local.end_pc].push_back(local_index);
-
-        local_index++;
     }
 
-    for(const auto& i : function.instructions)
+    for(const auto op : code.op)
     {
-        auto op = Operator(OP(i));
+        state.locals.advance(state.PC);
 
         unsigned locals_defined = 0;
 
@@ -1445,20 +1647,8 @@ Status parse_function(State& state, Ast*& ast, const Function& function)
         // handled separately from the ActionTable.
         if(state.PC > 0)
         {
-            if(local_spawn[state.PC].size() > 0)
-            {
-                for(const auto& index : local_spawn[state.PC])
-                {
-                    locals_defined += 1;
-                }
-            }
-            if(local_kill[state.PC].size() > 0)
-            {
-                for(const auto& index : local_kill[state.PC])
-                {
-                    state.reserved_elements -= 1;
-                }
-            }
+            locals_defined += state.locals.spawned(state.PC).size();
+            state.reserved_elements -= state.locals.killed(state.PC).size();
 
             if(locals_defined > 0)
             {
@@ -1466,29 +1656,36 @@ Status parse_function(State& state, Ast*& ast, const Function& function)
                 auto values = Vector<Expression>();
                 for(auto l = state.stack.size() - state.reserved_elements; l > 0; --l)
                 {
-                    values.push_back(std::get<Expression>(state.stack.back()));
-                    state.stack.pop_back();
+                    values.push_back(state.stack.pop_expression());
                 }
 
                 // Collect the local names and push them onto the stack.
-                auto locals = Vector<Identifier>();
-                for(const auto& index : local_spawn[state.PC])
+                auto locals = Vector<Expression>();
+                for(const auto& index : state.locals.spawned(state.PC))
                 {
-                    auto local = Identifier(function.locals[index].name);
-                    locals.push_back(local);
-                    state.stack.push_back(local);
+                    const auto name = function.locals[index].name;
+                    state.stack.push_back(identifier(arena, name));
+                    locals.push_back(identifier(arena, name));
                     state.reserved_elements += 1;
                 }
 
                 // Make the local definition
                 std::reverse(values.begin(), values.end());
-                auto definition = LocalDefinition(locals, values);
-                ast->statements.push_back(definition);
+                ast->statements.push_back(
+                    arena.statement(LocalDefinition(arena.list(locals), arena.list(values))));
             }
         }
 
         // Run the parsing function for the current operator.
-        const auto result = TABLE[op](state, ast, i, function);
+        const auto start  = state.profile ? HandlerProfile::Clock::now()
+                                          : HandlerProfile::Clock::time_point();
+        const auto result = TABLE[static_cast<size_t>(op)](state, ast, code, function);
+
+        if(state.profile)
+            state.profile->record(op, HandlerProfile::Clock::now() - start);
+
+        if(state.metrics)
+            state.metrics->count(op, state.stack.size());
 
         // Return on error.
         if(result != Status::OK)
@@ -1499,9 +1696,9 @@ Status parse_function(State& state, Ast*& ast, const Function& function)
                 "Parser error at line %d: %u (%s), instruction 0x%08X (%s) at PC %d.\n",
                 function.line_defined,
                 static_cast<unsigned>(result),
-                STATUS_TO_STR[result].c_str(),
-                i,
-                OP_TO_STR[OP(i)].c_str(),
+                STATUS_TO_STR.at(result).c_str(),
+                function.instructions[state.PC],
+                OP_TO_STR.at(op).c_str(),
                 state.PC);
 
             state.print();
@@ -1518,37 +1715,375 @@ Status parse_function(State& state, Ast*& ast, const Function& function)
             // Inline or comparison for an assignment (x = x or y)
             if(ast->context.is_or_block)
             {
-                auto left = std::get<Expression>(state.stack.back());
-                state.stack.pop_back();
+                auto left = state.stack.pop_expression();
 
                 auto& operation =
-                    std::get<AstOperation>(std::get<Expression>(state.stack.back()));
-                operation.ex.push_back(left);
+                    std::get<AstOperation>(arena[std::get<Expression>(state.stack.back())]);
+                arena.append(operation.ex, left);
 
                 ast->context.is_or_block = false;
             }
             // Handle the end of a condition block if the PC is right.
             while(ast->context.is_condition && state.PC >= ast->context.jump_offset)
             {
-                auto& condition = std::get<Condition>(ast->parent->statements.back());
+                auto* condition = parent_condition(state, ast);
+                if(condition == nullptr)
+                    return Status::BAD_VARIANT;
 
-                // Create an else block if the last jump operator was a JMP
-                if(ast->context.is_jmp_block)
-                {
-                    const auto operation = AstOperation("", {});
-                    const auto block     = ConditionBlock(operation, {});
-                    condition.blocks.push_back(block);
-                }
-
-                condition.blocks.back().statements = ast->statements;
-                ast->statements.clear();
+                close_condition_block(state, ast, *condition);
 
                 ast->context.is_condition = false;
                 exit_block(state, ast);
             }
         }
+
+        // Outside of every block only the last statement can still change, an
+        // assignment can get more variables. The nodes of the printed statements are
+        // dropped from time to time.
+        if(state.output && ast == arena.root() && ast->statements.size() > 1)
+        {
+            emit_statements(*state.output, arena, ast->statements, ast->statements.size() - 1);
+            arena.compact(ast->statements, state.stack);
+        }
+
         state.PC++;
     }
 
     return Status::OK;
 }
+
+// Public functions
+
+FunctionMemo::FunctionMemo(size_t limit)
+    : m_limit(limit)
+{
+}
+
+bool FunctionMemo::find(uint64_t hash, Status& status, AstArena& arena, Statements& statements)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto entry = m_entries.find(hash);
+    if(entry == m_entries.end() || entry->second.parses < 2)
+    {
+        m_misses += 1;
+        return false;
+    }
+
+    m_hits += 1;
+    entry->second.reused = true;
+    status               = entry->second.status;
+    statements           = arena.copy(*entry->second.arena, entry->second.statements);
+
+    return true;
+}
+
+void FunctionMemo::insert(
+    uint64_t        hash,
+    Status          status,
+    const AstArena& arena,
+    Statements      statements)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(m_entries.size() >= m_limit && m_entries.count(hash) == 0)
+        evict();
+
+    auto& entry = m_entries[hash];
+    if(++entry.parses == 2)
+    {
+        entry.reused     = true;
+        entry.status     = status;
+        entry.arena      = std::make_unique<AstArena>();
+        entry.statements = entry.arena->copy(arena, statements);
+    }
+}
+
+size_t FunctionMemo::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+/*
+ * @brief   Called with the mutex held. Clearing everything when few entries were freed
+ *          keeps the next eviction at least 'limit' / 2 insertions away.
+ */
+void FunctionMemo::evict()
+{
+    for(auto entry = m_entries.begin(); entry != m_entries.end();)
+    {
+        if(entry->second.reused)
+        {
+            entry->second.reused = false;
+            ++entry;
+        }
+        else
+        {
+            entry = m_entries.erase(entry);
+        }
+    }
+
+    if(m_entries.size() > m_limit / 2)
+        m_entries.clear();
+}
+
+size_t FunctionMemo::hits() const
+{
+    return m_hits;
+}
+
+size_t FunctionMemo::misses() const
+{
+    return m_misses;
+}
+
+/*
+ * @brief   Nested functions are hashed first, a function mixes in their hashes instead of
+ *          hashing them again. Every column of the decoded code is hashed, the handlers
+ *          read all of them.
+ */
+void hash_functions(const Function& function, FunctionHashes& hashes)
+{
+    for(const auto& nested : function.functions)
+        hash_functions(nested, hashes);
+
+    const auto& code = function.code;
+
+    const uint64_t sizes[] = {
+        code.size(),
+        function.numbers.size(),
+        function.globals.size(),
+        function.locals.size(),
+        function.functions.size(),
+        function.number_of_params,
+        function.is_variadic};
+
+    auto hash = hash_bytes(sizes, sizeof(sizes));
+    hash      = hash_bytes(code.op.data(), code.op.size() * sizeof(Operator), hash);
+    hash      = hash_bytes(code.a.data(), code.a.size() * sizeof(uint32_t), hash);
+    hash      = hash_bytes(code.b.data(), code.b.size() * sizeof(uint16_t), hash);
+    hash      = hash_bytes(code.u.data(), code.u.size() * sizeof(uint32_t), hash);
+    hash      = hash_bytes(code.s.data(), code.s.size() * sizeof(int32_t), hash);
+    hash = hash_bytes(function.numbers.data(), function.numbers.size() * sizeof(Number), hash);
+
+    for(const auto& global : function.globals)
+        hash = hash_bytes(global.data(), global.size(), hash);
+
+    for(const auto& local : function.locals)
+    {
+        const unsigned pcs[] = {local.start_pc, local.end_pc};
+        hash                 = hash_bytes(local.name.data(), local.name.size(), hash);
+        hash                 = hash_bytes(pcs, sizeof(pcs), hash);
+    }
+
+    for(const auto& nested : function.functions)
+    {
+        const auto nested_hash = hashes.at(&nested);
+        hash                   = hash_bytes(&nested_hash, sizeof(nested_hash), hash);
+    }
+
+    hashes[&function] = hash;
+}
+
+
+/*
+ * @brief   A malformed instruction stream can leave other elements on the stack than the
+ *          parsing functions expect, or too few. This is reported as an error instead of
+ *          unwinding through the caller.
+ */
+Status parse_block(State& state, Ast*& ast, const Function& function)
+{
+    try
+    {
+        return parse_instructions(state, ast, function);
+    }
+    catch(const std::bad_variant_access&)
+    {
+        return Status::BAD_VARIANT;
+    }
+    catch(const EmptyStack&)
+    {
+        return Status::EMPTY_STACK;
+    }
+}
+
+/*
+ * @brief   Hashes the functions for the memo before the first closure is parsed, unless
+ *          the caller already did. Returns true if the caller has to reset state.hashes.
+ */
+static bool hash_for_memo(State& state, const Function& function, FunctionHashes& hashes)
+{
+    if(state.memo == nullptr || state.hashes != nullptr)
+        return false;
+
+    hash_functions(function, hashes);
+    state.hashes = &hashes;
+
+    return true;
+}
+
+/*
+ * @brief   parse_block, which also records the time of the function if there are metrics,
+ *          and a span of it if there is a tracer. The spans of nested functions are inside
+ *          the span of the function that contains them.
+ */
+Status parse_measured(State& state, Ast*& ast, const Function& function)
+{
+    if(state.metrics == nullptr && state.tracer == nullptr)
+        return parse_block(state, ast, function);
+
+    const auto start  = Metrics::Clock::now();
+    const auto result = parse_block(state, ast, function);
+
+    if(state.metrics)
+    {
+        const auto seconds = std::chrono::duration<double>(Metrics::Clock::now() - start);
+        state.metrics->functions.push_back(
+            {function.line_defined, function.code.size(), seconds.count()});
+    }
+
+    if(state.tracer)
+    {
+        auto args = String("\"line_defined\": ") + std::to_string(function.line_defined) +
+                    ", \"instructions\": " + std::to_string(function.code.size()) +
+                    ", \"status\": \"" + STATUS_TO_STR.at(result) + "\"";
+        state.tracer->span("parse_function", start, std::move(args));
+    }
+
+    return result;
+}
+
+Status parse_function(State& state, AstArena& arena, const Function& function)
+{
+    auto* ast   = arena.root();
+    state.arena = &arena;
+
+    FunctionHashes hashes;
+    const auto     is_hashed = hash_for_memo(state, function, hashes);
+
+    auto result = parse_measured(state, ast, function);
+
+    if(is_hashed)
+        state.hashes = nullptr;
+
+    return result;
+}
+
+Status parse_function(
+    State&          state,
+    AstArena&       arena,
+    const Function& function,
+    StringBuffer&   output)
+{
+    auto* ast    = arena.root();
+    state.arena  = &arena;
+    state.output = &output;
+
+    FunctionHashes hashes;
+    const auto     is_hashed = hash_for_memo(state, function, hashes);
+
+    auto result = parse_measured(state, ast, function);
+
+    if(is_hashed)
+        state.hashes = nullptr;
+
+    // The last statement is final once the function ends.
+    auto& statements = arena.root()->statements;
+    if(result == Status::OK)
+    {
+        try
+        {
+            emit_statements(output, arena, statements, statements.size());
+        }
+        catch(const std::bad_variant_access&)
+        {
+            result = Status::BAD_VARIANT;
+        }
+    }
+
+    state.output = nullptr;
+
+    return result;
+}
+
+Status parse_function(
+    State&          state,
+    AstArena&       arena,
+    const Function& function,
+    ThreadPool&     pool)
+{
+    // Flatten the function tree. Parents come before their nested functions.
+    Vector<const Function*> functions = {&function};
+    Vector<size_t>          parents   = {0};
+    for(size_t i = 0; i < functions.size(); ++i)
+    {
+        for(const auto& nested : functions[i]->functions)
+        {
+            functions.push_back(&nested);
+            parents.push_back(i);
+        }
+    }
+
+    if(functions.size() == 1)
+        return parse_function(state, arena, function);
+
+    // The tasks only read the hashes.
+    FunctionHashes hashes;
+    const auto     is_hashed = hash_for_memo(state, function, hashes);
+
+    // The map is filled before any task runs, tasks only write to their own entry.
+    Prototypes prototypes;
+    for(size_t i = 1; i < functions.size(); ++i)
+        prototypes[functions[i]];
+
+    // Number of nested functions that still have to be parsed.
+    const auto pending = std::make_unique<std::atomic<size_t>[]>(functions.size());
+    for(size_t i = 0; i < functions.size(); ++i)
+        pending[i] = functions[i]->functions.size();
+
+    std::mutex              mutex;
+    std::condition_variable done;
+    bool                    is_done = false;
+
+    std::function<void(size_t)> parse = [&](size_t i)
+    {
+        parse_prototype(prototypes.at(functions[i]), *functions[i], prototypes, state);
+
+        const auto parent = parents[i];
+        if(pending[parent].fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        if(parent > 0)
+        {
+            pool.submit([&parse, parent] { parse(parent); });
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_done = true;
+            done.notify_one();
+        }
+    };
+
+    for(size_t i = 1; i < functions.size(); ++i)
+    {
+        if(pending[i] == 0)
+            pool.submit([&parse, i] { parse(i); });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return is_done; });
+    }
+
+    const auto* previous = state.prototypes;
+    state.prototypes     = &prototypes;
+    const auto result    = parse_function(state, arena, function);
+    state.prototypes     = previous;
+
+    if(is_hashed)
+        state.hashes = nullptr;
+
+    return result;
+}
@@ -3,6 +3,131 @@
 
 #include "ast/ast.hpp"
 #include "errors.hpp"
+#include "metrics/metrics.hpp"
+#include "thread/pool.hpp"
+
+#include <array>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+/*
+ * Result of a nested function that was parsed ahead of its parent, into an arena of its
+ * own. Exceptions thrown while parsing are rethrown when the parent reaches the closure.
+ * The statements are copied into the arena of the parent by each closure of the function.
+ */
+struct Prototype
+{
+    Status             status = Status::OK;
+    AstArena           arena;
+    Statements         statements;
+    std::exception_ptr exception;
+};
+
+using Prototypes = std::unordered_map<const Function*, Prototype>;
+
+/*
+ * Statements of the nested functions that were already parsed, by the hash of everything
+ * their statements depend on (see hash_functions). A byte-identical function, like a
+ * generated callback, is parsed twice and its statements are copied for every other
+ * closure. Only functions that repeat are copied into the memo, a unique function that
+ * contains all others is not. A memo can be shared by the threads of a batch, or by the
+ * requests of a server that runs for days. When the memo is full, the functions that were
+ * not reused since the memo was last full are forgotten to make room, and all of them are
+ * if that leaves it more than half full.
+ */
+class FunctionMemo
+{
+public:
+    static constexpr size_t DEFAULT_LIMIT = 1 << 16;
+
+    explicit FunctionMemo(size_t limit = DEFAULT_LIMIT);
+
+    /*
+     * @brief   Copies the statements of the function with 'hash' into 'arena' if it was
+     *          parsed before.
+     */
+    bool find(uint64_t hash, Status& status, AstArena& arena, Statements& statements);
+
+    /*
+     * @brief   Keeps a copy of the statements the second time the function is parsed.
+     *          A function that is new to a full memo evicts others first.
+     */
+    void insert(uint64_t hash, Status status, const AstArena& arena, Statements statements);
+
+    size_t size();
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    void evict();
+
+    struct Entry
+    {
+        unsigned                  parses = 0;
+        bool                      reused = false;  // since the last eviction
+        Status                    status = Status::OK;
+        std::unique_ptr<AstArena> arena;  // of the statements, once they are kept
+        Statements                statements;
+    };
+
+    size_t                              m_limit;
+    std::mutex                          m_mutex;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::atomic<size_t>                 m_hits   = 0;
+    std::atomic<size_t>                 m_misses = 0;
+};
+
+using FunctionHashes = std::unordered_map<const Function*, uint64_t>;
+
+/*
+ * @brief   Hashes a function and all functions nested in it. The hash of a function covers
+ *          every column of its decoded code (operators and the A, B, U and S arguments),
+ *          constants, locals, and the hashes of its nested functions. Names and line
+ *          numbers are left out, they do not change the statements.
+ */
+void hash_functions(const Function&, FunctionHashes&);
+
+/*
+ * The stack of the lua VM. A malformed instruction stream can pop more elements than were
+ * pushed. The stack throws EmptyStack instead of reading out of bounds, which
+ * parse_function reports as Status::EMPTY_STACK.
+ */
+struct EmptyStack
+{
+};
+
+class Stack : public Vector<AstElement>
+{
+public:
+    AstElement& back()
+    {
+        if(empty())
+            throw EmptyStack();
+
+        return Vector<AstElement>::back();
+    }
+
+    void pop_back()
+    {
+        if(empty())
+            throw EmptyStack();
+
+        Vector<AstElement>::pop_back();
+    }
+
+    /*
+     * @brief   Removes the top element and returns it. Throws std::bad_variant_access if
+     *          it is not an expression.
+     */
+    Expression pop_expression()
+    {
+        const auto expression = std::get<Expression>(back());
+        pop_back();
+        return expression;
+    }
+};
 
 /*
  * Remembering the state of a closure. Every closure needs their own stack and PC.
@@ -13,7 +138,16 @@ struct State
     unsigned           PC                = 0;
     unsigned           scope_level       = 0;
     unsigned           reserved_elements = 0;
-    Vector<AstElement> stack;
+    Stack              stack;
+    LocalScope         locals;
+    AstArena*          arena      = nullptr;
+    const Prototypes*  prototypes = nullptr;
+    StringBuffer*      output     = nullptr;  // only set for the main function
+    FunctionMemo*      memo       = nullptr;
+    FunctionHashes*    hashes     = nullptr;  // of every function, if there is a memo
+    Metrics*           metrics    = nullptr;  // not filled by the tasks of a pool
+    Tracer*            tracer     = nullptr;  // not filled by the tasks of a pool
+    HandlerProfile*    profile    = nullptr;  // not filled by the tasks of a pool
 
     void print();
 };
@@ -21,12 +155,32 @@ struct State
 /*
  * Every operator and therefore instruction, is mapped to a parsing function.
  * Each parsing function is passed the current state, the current program as AST, the
- * instruction, and the lua function that is parsed.
+ * decoded instructions (the current one is at state.PC), and the lua function that is
+ * parsed.
  * The parsing function returns a value > 0 if an errors occurred.
  */
-using Action      = Status (*)(State& state, Ast*&, const Instruction&, const Function&);
-using ActionTable = std::unordered_map<Operator, Action>;
+using Action      = Status (*)(State& state, Ast*&, const Code&, const Function&);
+using ActionTable = std::array<Action, size_t(1) << BITS_OP>;
+
+/*
+ * @brief   Parses 'function' into the root block of the arena. Every node of the tree is
+ *          allocated in the arena.
+ */
+Status parse_function(State&, AstArena&, const Function&);
 
-Status parse_function(State&, Ast*&, const Function&);
+/*
+ * @brief   Parses the nested functions of 'function' on the pool before the function
+ *          itself. A function is parsed as soon as all of its nested functions are done.
+ *          The result is the same as the one of parse_function.
+ */
+Status parse_function(State&, AstArena&, const Function&, ThreadPool&);
+
+/*
+ * @brief   Prints every top-level statement of 'function' to 'output' as soon as the
+ *          parser can no longer change it, and releases it. On success the root block is
+ *          empty afterwards and the output holds the whole program. On error the output
+ *          holds the statements that were final until then.
+ */
+Status parse_function(State&, AstArena&, const Function&, StringBuffer& output);
 
 #endif  // LUA4DEC_PARSER_H
@@ -0,0 +1,492 @@
+#include "server/server.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // SIGPIPE is ignored by the server instead
+#endif
+
+// Clients that connect while the server is busy wait in the queue of the socket.
+static constexpr int BACKLOG = 64;
+
+// How often the server checks whether it was stopped or a client is idle for too long.
+static constexpr int POLL_MILLISECONDS = 200;
+
+// The memory of a worker is kept for the next request unless a request needed more.
+static constexpr size_t KEEP_BYTES = size_t(16) << 20;
+
+/*
+ * What a worker keeps between requests.
+ */
+struct Session
+{
+    Vector<Byte> request;
+    AstArena     ast;
+    StringBuffer text;
+};
+
+// Of the worker that runs the task. Created by the first request the worker answers.
+static thread_local std::unique_ptr<Session> session;
+
+static bool read_all(int socket, void* data, size_t size)
+{
+    auto* bytes = static_cast<char*>(data);
+
+    while(size > 0)
+    {
+        const auto received = recv(socket, bytes, size, 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received <= 0)
+            return false;
+
+        bytes += received;
+        size -= size_t(received);
+    }
+
+    return true;
+}
+
+static bool write_all(int socket, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+
+    while(size > 0)
+    {
+        const auto sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+
+        bytes += sent;
+        size -= size_t(sent);
+    }
+
+    return true;
+}
+
+static bool make_address(const char* path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    const auto length = strlen(path);
+    if(length >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, path, length + 1);
+    return true;
+}
+
+/*
+ * @brief   A connected socket or -1.
+ */
+static int connect_to(const char* path)
+{
+    sockaddr_un address;
+    if(!make_address(path, address))
+        return -1;
+
+    const auto server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0)
+        return -1;
+
+    if(connect(server, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(server);
+        return -1;
+    }
+
+    return server;
+}
+
+DecompileServer::DecompileServer(String path, ThreadPool& pool, FunctionMemo* memo)
+    : m_path(std::move(path))
+    , m_pool(pool)
+    , m_memo(memo)
+{
+}
+
+DecompileServer::~DecompileServer()
+{
+    for(const auto end : m_wake)
+    {
+        if(end >= 0)
+            close(end);
+    }
+
+    if(m_socket < 0)
+        return;
+
+    close(m_socket);
+    unlink(m_path.c_str());
+}
+
+bool DecompileServer::listen()
+{
+    // A client that disconnects before its response is written is not an error.
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    if(!make_address(m_path.c_str(), address))
+        return false;
+
+    // Neither end blocks, a full pipe already wakes the server.
+    if(pipe(m_wake) != 0)
+        return false;
+
+    for(const auto end : m_wake)
+        fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+
+    const auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0)
+        return false;
+
+    const auto* name = reinterpret_cast<const sockaddr*>(&address);
+    auto        done = bind(listener, name, sizeof(address)) == 0;
+
+    // The file exists. Nobody answers on it if the server that created it is gone.
+    if(!done && errno == EADDRINUSE)
+    {
+        const auto running = connect_to(m_path.c_str());
+        if(running >= 0)
+        {
+            close(running);
+        }
+        else
+        {
+            unlink(m_path.c_str());
+            done = bind(listener, name, sizeof(address)) == 0;
+        }
+    }
+
+    if(!done || ::listen(listener, BACKLOG) != 0)
+    {
+        close(listener);
+        return false;
+    }
+
+    m_socket = listener;
+    return true;
+}
+
+/*
+ * @brief   The first two entries that are polled are the socket and the pipe that wakes
+ *          the server, the idle connections follow. A connection that can be read, which
+ *          includes one that was closed by its client, is handed to a task.
+ */
+void DecompileServer::serve()
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection
+    {
+        int               client;
+        Clock::time_point since;
+    };
+
+    const auto idle_limit = std::chrono::seconds(IDLE_SECONDS);
+
+    Vector<Connection> idle;
+    Vector<pollfd>     polled;
+
+    while(!m_stop)
+    {
+        polled.clear();
+        polled.push_back({m_socket, POLLIN, 0});
+        polled.push_back({m_wake[0], POLLIN, 0});
+
+        for(const auto& connection : idle)
+            polled.push_back({connection.client, POLLIN, 0});
+
+        if(poll(polled.data(), polled.size(), POLL_MILLISECONDS) < 0)
+            continue;
+
+        report_exceptions();
+
+        const auto now = Clock::now();
+
+        // Backwards, so the connection that is moved into a free slot was seen already.
+        for(size_t i = idle.size(); i-- > 0;)
+        {
+            const auto client = idle[i].client;
+
+            if(polled[i + 2].revents != 0)
+                m_pool.submit([this, client] { give_back(client); });
+            else if(now - idle[i].since > idle_limit)
+                close(client);
+            else
+                continue;
+
+            idle[i] = idle.back();
+            idle.pop_back();
+        }
+
+        if(polled[1].revents != 0)
+        {
+            char drained[64];
+            while(read(m_wake[0], drained, sizeof(drained)) > 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(const auto client : m_returned)
+                idle.push_back({client, now});
+
+            m_returned.clear();
+        }
+
+        if(polled[0].revents == 0)
+            continue;
+
+        const auto client = accept(m_socket, nullptr, nullptr);
+        if(client < 0)
+            continue;
+
+        // A request or a response that stops in the middle is given up after the same time.
+        timeval timeout = {IDLE_SECONDS, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        idle.push_back({client, now});
+    }
+
+    // Clients that connect from now on fail right away instead of waiting.
+    close(m_socket);
+    unlink(m_path.c_str());
+    m_socket = -1;
+
+    m_pool.wait();
+    report_exceptions();
+
+    for(const auto& connection : idle)
+        close(connection.client);
+
+    for(const auto client : m_returned)
+        close(client);
+
+    m_returned.clear();
+}
+
+void DecompileServer::stop()
+{
+    m_stop = true;
+}
+
+/*
+ * @brief   The pool keeps the exceptions of its tasks until they are taken, so they are
+ *          taken on every turn of 'serve' instead of piling up for the life of the server.
+ */
+void DecompileServer::report_exceptions()
+{
+    for(const auto& exception : m_pool.take_exceptions())
+    {
+        try
+        {
+            std::rethrow_exception(exception);
+        }
+        catch(const std::exception& error)
+        {
+            fprintf(stderr, "A request ended with an exception: %s\n", error.what());
+        }
+        catch(...)
+        {
+            fprintf(stderr, "A request ended with an exception.\n");
+        }
+    }
+}
+
+/*
+ * @brief   Answers one request of the client. False if the client disconnected or sent a
+ *          malformed request, or the response could not be written.
+ */
+bool DecompileServer::handle(int client)
+{
+    RequestHeader header;
+    RequestHeader expected;
+
+    if(!read_all(client, &header, sizeof(header)))
+        return false;
+
+    const auto kind = static_cast<RequestKind>(header.kind);
+    if(memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+       kind >= RequestKind::UNDEFINED || header.size > MAX_REQUEST)
+        return false;
+
+    if(!session)
+        session = std::make_unique<Session>();
+
+    auto& request = session->request;
+    request.resize(size_t(header.size));
+    if(!read_all(client, request.data(), request.size()))
+        return false;
+
+    auto error = Error();
+    if(kind == RequestKind::PATH)
+    {
+        // Opening a FIFO or a device could block the worker, only files are read.
+        const auto  path = String(request.begin(), request.end());
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+            error = Error{Status::FILE_NOT_READABLE, 0};
+        else
+            error = decompile_to_text(path.c_str(), session->ast, session->text, m_memo);
+    }
+    else
+    {
+        error = decompile_to_text(
+            request.data(), request.size(), session->ast, session->text, m_memo);
+    }
+
+    const auto text = session->text.view();
+
+    auto response   = ResponseHeader();
+    response.status = static_cast<uint32_t>(error.status);
+    response.offset = error.offset;
+    response.size   = error.status == Status::OK ? text.size() : 0;
+
+    const auto sent = write_all(client, &response, sizeof(response)) &&
+                      write_all(client, text.data(), size_t(response.size));
+
+    // The tree is not needed anymore, large buffers are given back.
+    session->ast.clear();
+    if(request.capacity() + text.size() > KEEP_BYTES)
+        session.reset();
+
+    return sent;
+}
+
+/*
+ * @brief   Runs on the pool. Answers a request and gives the connection back to 'serve' to
+ *          wait for the next one, or closes it. An exception closes the connection and
+ *          drops the session, then it is left to the pool for 'serve' to report.
+ */
+void DecompileServer::give_back(int client)
+{
+    try
+    {
+        if(!handle(client))
+        {
+            close(client);
+            return;
+        }
+    }
+    catch(...)
+    {
+        close(client);
+        session.reset();
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_returned.push_back(client);
+    }
+
+    // A write that fails because the pipe is full is not needed, 'serve' wakes anyway.
+    const char                  wake  = 0;
+    [[maybe_unused]] const auto woken = write(m_wake[1], &wake, 1);
+}
+
+Error request_decompile(
+    const char* path,
+    RequestKind kind,
+    StringView  bytes,
+    String&     text)
+{
+    const auto server = connect_to(path);
+    if(server < 0)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    RequestHeader request;
+    request.kind = static_cast<uint32_t>(kind);
+    request.size = bytes.size();
+
+    ResponseHeader response;
+    ResponseHeader expected;
+
+    auto done = write_all(server, &request, sizeof(request)) &&
+                write_all(server, bytes.data(), bytes.size()) &&
+                read_all(server, &response, sizeof(response)) &&
+                memcmp(response.magic, expected.magic, sizeof(response.magic)) == 0 &&
+                response.status <= static_cast<uint32_t>(Status::UNDEFINED);
+
+    if(done)
+    {
+        text.resize(size_t(response.size));
+        done = read_all(server, text.data(), text.size());
+    }
+
+    close(server);
+
+    if(!done)
+        return Error{Status::FILE_NOT_READABLE, 0};
+
+    return Error{static_cast<Status>(response.status), size_t(response.offset)};
+}
+
+#else
+
+DecompileServer::DecompileServer(String path, ThreadPool& pool, FunctionMemo* memo)
+    : m_path(std::move(path))
+    , m_pool(pool)
+    , m_memo(memo)
+{
+}
+
+DecompileServer::~DecompileServer()
+{
+}
+
+bool DecompileServer::listen()
+{
+    return false;
+}
+
+void DecompileServer::serve()
+{
+}
+
+void DecompileServer::stop()
+{
+    m_stop = true;
+}
+
+bool DecompileServer::handle(int client)
+{
+    return false;
+}
+
+void DecompileServer::give_back(int client)
+{
+}
+
+void DecompileServer::report_exceptions()
+{
+}
+
+Error request_decompile(
+    const char* path,
+    RequestKind kind,
+    StringView  bytes,
+    String&     text)
+{
+    return Error{Status::FILE_NOT_READABLE, 0};
+}
+
+#endif
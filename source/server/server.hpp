@@ -0,0 +1,102 @@
+#ifndef LUA4DEC_SERVER_H
+#define LUA4DEC_SERVER_H
+
+#include "lua4dec.hpp"
+
+/*
+ * Frames of the protocol of the server. A client sends a request header followed by
+ * 'size' bytes, the server answers with a response header followed by 'size' bytes of
+ * text. A connection can carry any number of requests, one after another. Headers are in
+ * the byte order of the machine, client and server run on the same one.
+ */
+enum class RequestKind : uint32_t
+{
+    PATH = 0x00,  // the bytes are the path of a compiled file, as the server sees it
+    CHUNK,        // the bytes are the compiled chunk itself
+    UNDEFINED,
+};
+
+struct RequestHeader
+{
+    char     magic[4] = {'L', '4', 'D', 'Q'};
+    uint32_t kind     = 0;
+    uint64_t size     = 0;
+};
+
+struct ResponseHeader
+{
+    char     magic[4] = {'L', '4', 'D', 'R'};
+    uint32_t status   = 0;
+    uint64_t offset   = 0;  // of the byte at which loading failed
+    uint64_t size     = 0;
+};
+
+/*
+ * Decompiles the requests of local clients on a Unix domain socket, so that a tool that
+ * decompiles many small files does not start a process for each of them. The thread that
+ * calls 'serve' watches every open connection. A connection is handed to a task of the
+ * pool only when its client sent something, the task answers one request and gives the
+ * connection back. Idle clients do not hold a worker, as many requests as the pool has
+ * workers are answered at the same time. Each worker keeps its arena and buffers between
+ * requests, and identical functions of all requests are parsed once with the memo. The
+ * memo forgets functions that are not reused, so it keeps up with what the clients send.
+ * Only available on POSIX systems.
+ */
+class DecompileServer
+{
+public:
+    // Larger requests close the connection.
+    static constexpr uint64_t MAX_REQUEST = uint64_t(1) << 30;
+
+    // A client that sends nothing for this long is disconnected. A request or a response
+    // that stops in the middle for this long is given up, which frees its worker.
+    static constexpr int IDLE_SECONDS = 30;
+
+    DecompileServer(String path, ThreadPool& pool, FunctionMemo* memo = nullptr);
+    DecompileServer(const DecompileServer&)            = delete;
+    DecompileServer& operator=(const DecompileServer&) = delete;
+    ~DecompileServer();
+
+    /*
+     * @brief   Creates the socket file. A file that is left over from a server that is
+     *          not running anymore is replaced, the socket of a running server is not.
+     */
+    bool listen();
+
+    /*
+     * @brief   Accepts clients until 'stop' is called, removes the socket file, waits for
+     *          the requests that are being answered, and closes every connection.
+     */
+    void serve();
+
+    /*
+     * @brief   Only sets a flag, it can be called from a signal handler.
+     */
+    void stop();
+
+private:
+    bool handle(int client);
+    void give_back(int client);
+    void report_exceptions();
+
+    String            m_path;
+    ThreadPool&       m_pool;
+    FunctionMemo*     m_memo;
+    int               m_socket  = -1;
+    int               m_wake[2] = {-1, -1};  // wakes 'serve' when a connection is given back
+    std::atomic<bool> m_stop{false};
+    std::mutex        m_mutex;
+    Vector<int>       m_returned;  // connections given back by the tasks
+};
+
+/*
+ * @brief   Sends one request to the server at 'path' and waits for the text of the
+ *          response. Fails with FILE_NOT_READABLE if there is no server to talk to.
+ */
+Error request_decompile(
+    const char* path,
+    RequestKind kind,
+    StringView  bytes,
+    String&     text);
+
+#endif  // LUA4DEC_SERVER_H
@@ -0,0 +1,159 @@
+#include "thread/pool.hpp"
+
+#include <utility>
+
+// Index of the queue that belongs to the current worker thread.
+static thread_local ThreadPool* current_pool   = nullptr;
+static thread_local unsigned    current_worker = 0;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for(unsigned i = 0; i < threads; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    for(unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back([this, i] { run(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for(auto& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::submit(Task task)
+{
+    const auto worker = current_pool == this
+                          ? current_worker
+                          : m_next_queue.fetch_add(1) % unsigned(m_queues.size());
+
+    {
+        auto&                       queue = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued += 1;
+        m_unfinished += 1;
+        m_submitted += 1;
+    }
+    m_wake.notify_one();
+    m_pushed.notify_all();
+}
+
+/*
+ * @brief   Blocks until every submitted task, including the ones that are submitted by
+ *          tasks, has finished. Must not be called from a worker.
+ */
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_unfinished == 0; });
+}
+
+unsigned ThreadPool::size() const
+{
+    return unsigned(m_threads.size());
+}
+
+Vector<std::exception_ptr> ThreadPool::take_exceptions()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::exchange(m_exceptions, {});
+}
+
+bool ThreadPool::pop(unsigned worker, Task& task)
+{
+    auto&                       queue = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if(queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned worker, Task& task)
+{
+    const auto size = unsigned(m_queues.size());
+    for(unsigned i = 1; i < size; ++i)
+    {
+        auto&                       queue = *m_queues[(worker + i) % size];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if(!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned worker)
+{
+    current_pool   = this;
+    current_worker = worker;
+
+    while(true)
+    {
+        size_t submitted = 0;
+        {
+            // Sleep until a task is queued. Each queued task is claimed by one worker.
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+
+            if(m_queued == 0)
+                return;
+
+            m_queued -= 1;
+            submitted = m_submitted;
+        }
+
+        // There are at least as many queued tasks as claims, but the queues are searched
+        // one after another. If another worker took the task this worker would have found
+        // and the one that is left was pushed into a queue that was already searched, a
+        // task was submitted during the search and it is searched again.
+        Task task;
+        while(!pop(worker, task) && !steal(worker, task))
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_pushed.wait(lock, [this, submitted] { return m_submitted != submitted; });
+            submitted = m_submitted;
+        }
+
+        auto exception = std::exception_ptr();
+        try
+        {
+            task();
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(exception)
+                m_exceptions.push_back(std::move(exception));
+
+            m_unfinished -= 1;
+            if(m_unfinished == 0)
+                m_idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef LUA4DEC_POOL_H
+#define LUA4DEC_POOL_H
+
+#include "lua/lua.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * Work stealing thread pool. Every worker owns a queue. A task that is submitted from a
+ * worker goes into the queue of that worker, other tasks are distributed round-robin.
+ * Workers take the newest task of their own queue and steal the oldest task of another
+ * queue when their own queue is empty. An exception that leaves a task is caught by the
+ * worker and kept, it does not end the process.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threads = 0);
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    void     submit(Task task);
+    void     wait();
+    unsigned size() const;
+
+    /*
+     * @brief   The exceptions that left tasks since the last call, one per task.
+     */
+    Vector<std::exception_ptr> take_exceptions();
+
+private:
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(unsigned worker, Task& task);
+    bool steal(unsigned worker, Task& task);
+    void run(unsigned worker);
+
+    Vector<std::unique_ptr<Queue>> m_queues;
+    Vector<std::thread>            m_threads;
+    std::atomic<unsigned>          m_next_queue{0};
+
+    std::mutex                 m_mutex;
+    std::condition_variable    m_wake;
+    std::condition_variable    m_idle;
+    std::condition_variable    m_pushed;
+    size_t                     m_queued     = 0;  // guarded by m_mutex
+    size_t                     m_unfinished = 0;  // guarded by m_mutex
+    size_t                     m_submitted  = 0;  // guarded by m_mutex
+    Vector<std::exception_ptr> m_exceptions;      // guarded by m_mutex
+    bool                       m_stop = false;
+};
+
+#endif  // LUA4DEC_POOL_H
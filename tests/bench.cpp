@@ -0,0 +1,674 @@
+#include "batch/batch.hpp"
+#include "chunk.hpp"
+#include "lua4dec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+constexpr const char* NULL_DEVICE = "NUL";
+#else
+constexpr const char* NULL_DEVICE = "/dev/null";
+#endif
+
+/*
+ * Synthetic input
+ */
+
+/*
+ * @brief   A function with 'statements' global assignments (g = <int>) that is valid
+ *          input for the parser.
+ */
+Function synthetic_function(unsigned statements)
+{
+    static const StringView GLOBALS[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+
+    Function function;
+    function.name           = "@synthetic.lua";
+    function.max_stack_size = 2;
+    function.globals.assign(std::begin(GLOBALS), std::end(GLOBALS));
+
+    for(unsigned i = 0; i < statements; ++i)
+    {
+        function.instructions.push_back(encode_s(Operator::PUSHINT, int(i)));
+        function.instructions.push_back(encode_u(Operator::SETGLOBAL, i % 8));
+    }
+    function.instructions.push_back(encode(Operator::END));
+
+    return function;
+}
+
+/*
+ * @brief   A main function that assigns 'closures' closures of 'statements' statements
+ *          each to globals.
+ */
+Function synthetic_chunk(unsigned closures, unsigned statements)
+{
+    auto main = synthetic_function(statements);
+    main.instructions.pop_back();
+
+    for(unsigned i = 0; i < closures; ++i)
+    {
+        main.functions.push_back(synthetic_function(statements));
+        main.instructions.push_back(encode_ab(Operator::CLOSURE, i, 0));
+        main.instructions.push_back(encode_u(Operator::SETGLOBAL, i % 8));
+    }
+    main.instructions.push_back(encode(Operator::END));
+
+    return main;
+}
+
+/*
+ * @brief   'depth' if statements nested in each other: if g then if g then ... g = 1 end end
+ */
+Function nested_conditions(unsigned depth)
+{
+    Function function;
+    function.name    = "@nested.lua";
+    function.globals = {"g"};
+
+    // Every block ends with the assignment in the innermost block.
+    const auto last = int(2 * depth + 1);
+    for(unsigned i = 0; i < depth; ++i)
+    {
+        function.instructions.push_back(encode_u(Operator::GETGLOBAL, 0));
+        function.instructions.push_back(encode_s(Operator::JMPF, last - int(2 * i + 1)));
+    }
+    function.instructions.push_back(encode_s(Operator::PUSHINT, 1));
+    function.instructions.push_back(encode_u(Operator::SETGLOBAL, 0));
+    function.instructions.push_back(encode(Operator::END));
+
+    return function;
+}
+
+/*
+ * @brief   'depth' numeric for loops nested in each other: for i = 1, 10 do for ... end end
+ */
+Function nested_loops(unsigned depth)
+{
+    Function function;
+    function.name    = "@nested.lua";
+    function.globals = {"g"};
+
+    for(unsigned i = 0; i < depth; ++i)
+    {
+        function.instructions.push_back(encode_s(Operator::PUSHINT, 1));
+        function.instructions.push_back(encode_s(Operator::PUSHINT, 10));
+        function.instructions.push_back(encode_s(Operator::PUSHINT, 1));
+        function.instructions.push_back(encode_s(Operator::FORPREP, 0));
+    }
+    function.instructions.push_back(encode_u(Operator::GETLOCAL, 0));
+    function.instructions.push_back(encode_u(Operator::SETGLOBAL, 0));
+
+    // The counter, limit, and step of a loop live from its FORPREP to its FORLOOP.
+    for(unsigned i = 0; i < depth; ++i)
+    {
+        const auto start = 4 * i + 4;
+        const auto end   = 4 * depth + 2 + (depth - 1 - i);
+        function.locals.push_back(Local{"i", start, end});
+        function.locals.push_back(Local{"(limit)", start, end});
+        function.locals.push_back(Local{"(step)", start, end});
+    }
+    for(unsigned i = 0; i < depth; ++i)
+        function.instructions.push_back(encode_s(Operator::FORLOOP, 0));
+
+    function.instructions.push_back(encode(Operator::END));
+
+    return function;
+}
+
+/*
+ * @brief   'depth' functions nested in each other: g = function() g = function() ... end end
+ */
+Function nested_closures(unsigned depth)
+{
+    Function function;
+    function.name         = "@nested.lua";
+    function.globals      = {"g"};
+    function.instructions = {
+        encode_s(Operator::PUSHINT, 1),
+        encode_u(Operator::SETGLOBAL, 0),
+        encode(Operator::END)};
+
+    for(unsigned i = 0; i < depth; ++i)
+    {
+        Function parent;
+        parent.name    = "@nested.lua";
+        parent.globals = {"g"};
+        parent.functions.push_back(std::move(function));
+        parent.instructions = {
+            encode_ab(Operator::CLOSURE, 0, 0),
+            encode_u(Operator::SETGLOBAL, 0),
+            encode(Operator::END)};
+
+        function = std::move(parent);
+    }
+
+    return function;
+}
+
+/*
+ * Measurement
+ */
+
+template<typename Fn>
+double best_of(unsigned repetitions, Fn&& fn)
+{
+    double best = 0;
+    for(unsigned i = 0; i < repetitions; ++i)
+    {
+        const auto start   = Clock::now();
+        fn();
+        const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if(i == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+/*
+ * Best time of a benchmark and the amount of work ('unit's) done in it.
+ */
+struct Result
+{
+    String name;
+    double seconds;
+    size_t amount;
+    String unit;
+};
+
+static Vector<Result> results;
+
+/*
+ * @brief   Prints the time of one run and the throughput in millions of 'unit' per second.
+ *          The result is kept for the JSON report.
+ */
+void report(const char* name, double seconds, size_t amount, const char* unit)
+{
+    printf("%-36s %10.3f ms %10.1f M%s/s\n", name, seconds * 1000, amount / seconds / 1e6, unit);
+    results.push_back({name, seconds, amount, unit});
+}
+
+/*
+ * @brief   Writes the results as JSON, one object per benchmark. Throughput is in 'unit's
+ *          per second.
+ */
+bool write_json(const char* filename, unsigned repetitions)
+{
+    auto* stream = fopen(filename, "w");
+    if(stream == nullptr)
+        return false;
+
+#ifdef NDEBUG
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+
+    fprintf(stream, "{\n");
+    fprintf(stream, "  \"repetitions\": %u,\n", repetitions);
+    fprintf(stream, "  \"build\": \"%s\",\n", build);
+    fprintf(stream, "  \"results\": [\n");
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& result = results[i];
+        fprintf(
+            stream,
+            "    {\"name\": \"%s\", \"seconds\": %.9f, \"amount\": %zu, "
+            "\"unit\": \"%s\", \"throughput\": %.1f}%s\n",
+            result.name.c_str(),
+            result.seconds,
+            result.amount,
+            result.unit.c_str(),
+            result.seconds > 0 ? result.amount / result.seconds : 0.0,
+            i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(stream, "  ]\n}\n");
+
+    return fclose(stream) == 0;
+}
+
+/*
+ * Benchmarks
+ */
+
+void bench_load(unsigned repetitions)
+{
+    const auto main = synthetic_chunk(256, 2048);
+
+    const auto little = ChunkWriter(8, 8, true).write(main);
+    const auto big    = ChunkWriter(8, 8, false).write(main);
+
+    auto load = [](const Vector<Byte>& bytes)
+    {
+        Chunk chunk;
+        read_chunk(bytes.data(), bytes.size(), chunk);
+        return chunk.main.functions.size();
+    };
+
+    const auto little_seconds = best_of(repetitions, [&] { load(little); });
+    const auto big_seconds    = best_of(repetitions, [&] { load(big); });
+
+    report("load/little-endian", little_seconds, little.size(), "B");
+    report("load/big-endian", big_seconds, big.size(), "B");
+
+    // Few functions with long instruction arrays. The little-endian instructions are
+    // borrowed from the input if they are aligned, the big-endian ones are copied.
+    const auto large        = synthetic_chunk(4, 1 << 18);
+    const auto large_little = ChunkWriter(8, 8, true).write(large);
+    const auto large_big    = ChunkWriter(8, 8, false).write(large);
+
+    report("load/large-functions/little-endian",
+           best_of(repetitions, [&] { load(large_little); }),
+           large_little.size(),
+           "B");
+    report("load/large-functions/big-endian",
+           best_of(repetitions, [&] { load(large_big); }),
+           large_big.size(),
+           "B");
+
+    // Scanning for the functions of a chunk compared to loading all of them, and
+    // loading only the last function after the scan.
+    auto index = [&](const Vector<Byte>& bytes)
+    {
+        ChunkIndex index;
+        index_chunk(bytes.data(), bytes.size(), index);
+        return index.functions.size();
+    };
+
+    ChunkIndex last;
+    index_chunk(little.data(), little.size(), last);
+
+    auto load_last = [&]
+    {
+        Chunk chunk;
+        read_function_at(last, last.functions.size() - 1, chunk);
+    };
+
+    report(
+        "index/little-endian",
+        best_of(repetitions, [&] { index(little); }),
+        little.size(),
+        "B");
+    report("index/load-one-function", best_of(repetitions, load_last), little.size(), "B");
+
+    Vector<Instruction> instructions(1 << 20, 0x12345678);
+    auto                swap = [&] { swap_byte_order(instructions.data(), instructions.size()); };
+
+    report("swap/instructions", best_of(repetitions, swap), instructions.size() * 4, "B");
+}
+
+/*
+ * @brief   Cost of the dispatch alone. A stream of operators is dispatched to trivial
+ *          handlers through a hash map keyed by the operator (the former ActionTable) and
+ *          through an array indexed by the operator (the current ActionTable).
+ */
+void bench_dispatch(unsigned repetitions)
+{
+    using Handler = void (*)(size_t&);
+
+    static constexpr size_t NUM_OPERATORS = size_t(Operator::CLOSURE) + 1;
+
+    Handler even = [](size_t& n) { n += 1; };
+    Handler odd  = [](size_t& n) { n += 2; };
+
+    std::unordered_map<Operator, Handler>     map;
+    std::array<Handler, size_t(1) << BITS_OP> array{};
+    for(size_t op = 0; op < NUM_OPERATORS; ++op)
+    {
+        map[Operator(op)] = op % 2 ? odd : even;
+        array[op]         = op % 2 ? odd : even;
+    }
+
+    Vector<Operator> ops(1 << 22);
+    uint32_t         seed = 1;
+    for(auto& op : ops)
+    {
+        seed = seed * 1664525 + 1013904223;
+        op   = Operator((seed >> 16) % NUM_OPERATORS);
+    }
+
+    size_t n = 0;
+
+    auto dispatch_map = [&]
+    {
+        for(const auto op : ops)
+            map[op](n);
+    };
+    auto dispatch_array = [&]
+    {
+        for(const auto op : ops)
+            array[static_cast<size_t>(op)](n);
+    };
+
+    report("dispatch/hash-map", best_of(repetitions, dispatch_map), ops.size(), "instr");
+    report("dispatch/array", best_of(repetitions, dispatch_array), ops.size(), "instr");
+
+    if(n == 0)
+        printf("Nothing was dispatched.\n");
+}
+
+/*
+ * @brief   Throughput of parse_function (instruction dispatch and handlers).
+ */
+void bench_parse(unsigned repetitions)
+{
+    const auto bytes = ChunkWriter().write(synthetic_chunk(64, 1024));
+    Chunk      chunk;
+    read_chunk(bytes.data(), bytes.size(), chunk);
+
+    size_t instructions = chunk.main.instructions.size();
+    for(const auto& function : chunk.main.functions)
+        instructions += function.instructions.size();
+
+    auto parse = [&]
+    {
+        auto ast   = AstArena();
+        auto state = State();
+        parse_function(state, ast, chunk.main);
+    };
+
+    auto pool          = ThreadPool();
+    auto parse_on_pool = [&]
+    {
+        auto ast   = AstArena();
+        auto state = State();
+        parse_function(state, ast, chunk.main, pool);
+    };
+
+    // The closures of the synthetic chunk are identical, all but the first are copied.
+    auto parse_with_memo = [&]
+    {
+        auto memo  = FunctionMemo();
+        auto ast   = AstArena();
+        auto state = State();
+        state.memo = &memo;
+        parse_function(state, ast, chunk.main);
+    };
+
+    report("parse/instructions", best_of(repetitions, parse), instructions, "instr");
+    report("parse/instructions (pool)", best_of(repetitions, parse_on_pool), instructions, "instr");
+    report("parse/instructions (memo)", best_of(repetitions, parse_with_memo), instructions, "instr");
+}
+
+/*
+ * @brief   Throughput of print_ast in bytes of emitted lua, into memory and into a file.
+ */
+void bench_print(unsigned repetitions)
+{
+    const auto bytes = ChunkWriter().write(synthetic_chunk(64, 4096));
+    Chunk      chunk;
+    read_chunk(bytes.data(), bytes.size(), chunk);
+
+    auto ast   = AstArena();
+    auto state = State();
+    parse_function(state, ast, chunk.main);
+
+    size_t size = 0;
+
+    auto print_to_memory = [&]
+    {
+        StringBuffer buffer;
+        print_ast(ast, buffer);
+        size = buffer.size();
+    };
+
+    auto* null = fopen(NULL_DEVICE, "w");
+    if(null == nullptr)
+        return;
+
+    auto print_to_file = [&] { print_ast(ast, null); };
+
+    const auto memory_seconds = best_of(repetitions, print_to_memory);
+    const auto file_seconds   = best_of(repetitions, print_to_file);
+
+    report("print/memory", memory_seconds, size, "B");
+    report("print/file", file_seconds, size, "B");
+
+    fclose(null);
+}
+
+/*
+ * @brief   Parsing deeply nested blocks. The time per level has to stay the same when the
+ *          depth grows, a nested block must not be copied into each enclosing one.
+ */
+void bench_nesting(unsigned repetitions)
+{
+    struct Input
+    {
+        const char* name;
+        Function (*make)(unsigned depth);
+        unsigned depths[2];
+    };
+
+    // Functions cannot be nested deeper than the loader accepts.
+    const Input inputs[] = {
+        {"parse/nested-if", nested_conditions, {250, 1000}},
+        {"parse/nested-for", nested_loops, {250, 1000}},
+        {"parse/nested-closure", nested_closures, {50, MAX_NESTING}},
+    };
+
+    for(const auto& input : inputs)
+    {
+        for(unsigned depth : input.depths)
+        {
+            const auto bytes = ChunkWriter().write(input.make(depth));
+            Chunk      chunk;
+            read_chunk(bytes.data(), bytes.size(), chunk);
+
+            auto parse = [&]
+            {
+                auto ast   = AstArena();
+                auto state = State();
+                parse_function(state, ast, chunk.main);
+            };
+
+            const auto name = String(input.name) + "/" + std::to_string(depth);
+            report(name.c_str(), best_of(repetitions, parse), depth, "level");
+        }
+    }
+}
+
+size_t count_instructions(const Function& function)
+{
+    size_t instructions = function.instructions.size();
+    for(const auto& nested : function.functions)
+        instructions += count_instructions(nested);
+
+    return instructions;
+}
+
+/*
+ * @brief   What luadec does for a single file: map the file, load the chunk, parse it,
+ *          and print it (to the null device).
+ */
+size_t decompile_to_null(const char* filename, FILE* null)
+{
+    Chunk chunk;
+    if(load_chunk(chunk, filename).status != Status::OK)
+        return 0;
+
+    auto ast   = AstArena();
+    auto state = State();
+    if(parse_function(state, ast, chunk.main) != Status::OK)
+        return 0;
+
+    print_ast(ast, null);
+
+    return count_instructions(chunk.main);
+}
+
+/*
+ * @brief   End-to-end runs on a synthetic chunk that is written to a temporary file.
+ */
+void bench_end_to_end(unsigned repetitions)
+{
+    const auto bytes    = ChunkWriter().write(synthetic_chunk(64, 4096));
+    const auto filename = (fs::temp_directory_path() / "lua4dec-bench.out").string();
+
+    auto* stream = fopen(filename.c_str(), "wb");
+    auto* null   = fopen(NULL_DEVICE, "w");
+    if(stream == nullptr || null == nullptr)
+        return;
+
+    fwrite(bytes.data(), 1, bytes.size(), stream);
+    fclose(stream);
+
+    auto run = [&] { decompile_to_null(filename.c_str(), null); };
+
+    report("end-to-end/synthetic", best_of(repetitions, run), bytes.size(), "B");
+
+    fclose(null);
+    remove(filename.c_str());
+}
+
+/*
+ * @brief   Loading, parsing, printing, and end-to-end runs over a corpus of compiled
+ *          scripts, for example tests/scripts after the roundtrip test compiled it. The
+ *          files of each phase are measured together.
+ */
+void bench_corpus(unsigned repetitions, const Vector<String>& inputs)
+{
+    Vector<String>       files;
+    Vector<Vector<Byte>> contents;
+    size_t               bytes = 0;
+
+    // Only files that decompile are measured, sources and other files are skipped.
+    for(const auto& file : collect_files(inputs))
+    {
+        auto  content = read_file(file.c_str());
+        Chunk chunk;
+        if(content.empty())
+            continue;
+
+        if(read_chunk(content.data(), content.size(), chunk).status != Status::OK)
+            continue;
+
+        bytes += content.size();
+        files.push_back(file);
+        contents.push_back(std::move(content));
+    }
+
+    if(files.empty())
+    {
+        printf("No compiled scripts in the corpus.\n");
+        return;
+    }
+
+    Vector<Chunk> chunks(files.size());
+    size_t        instructions = 0;
+    for(size_t i = 0; i < files.size(); ++i)
+    {
+        read_chunk(contents[i].data(), contents[i].size(), chunks[i]);
+        instructions += count_instructions(chunks[i].main);
+    }
+
+    auto load = [&]
+    {
+        for(const auto& content : contents)
+        {
+            Chunk chunk;
+            read_chunk(content.data(), content.size(), chunk);
+        }
+    };
+
+    auto parse = [&]
+    {
+        for(const auto& chunk : chunks)
+        {
+            auto ast   = AstArena();
+            auto state = State();
+            parse_function(state, ast, chunk.main);
+        }
+    };
+
+    Vector<AstArena> asts(chunks.size());
+    for(size_t i = 0; i < chunks.size(); ++i)
+    {
+        auto state = State();
+        parse_function(state, asts[i], chunks[i].main);
+    }
+
+    size_t text = 0;
+    auto   print = [&]
+    {
+        text = 0;
+        for(const auto& ast : asts)
+        {
+            StringBuffer buffer;
+            print_ast(ast, buffer);
+            text += buffer.size();
+        }
+    };
+
+    auto* null = fopen(NULL_DEVICE, "w");
+    if(null == nullptr)
+        return;
+
+    auto end_to_end = [&]
+    {
+        for(const auto& file : files)
+            decompile_to_null(file.c_str(), null);
+    };
+
+    // The size of the text is known after printing.
+    const auto print_seconds = best_of(repetitions, print);
+
+    report("corpus/load", best_of(repetitions, load), bytes, "B");
+    report("corpus/parse", best_of(repetitions, parse), instructions, "instr");
+    report("corpus/print", print_seconds, text, "B");
+    report("corpus/end-to-end", best_of(repetitions, end_to_end), bytes, "B");
+
+    fclose(null);
+}
+
+/*
+ * Usage: bench [repetitions] [--json <file>] [--corpus <directory, @list, or file>]...
+ * Every benchmark is run 'repetitions' times (10 by default) and the best time counts.
+ * The inputs are generated with fixed contents, results of two builds are comparable.
+ */
+int main(int argc, char** argv)
+{
+    unsigned       repetitions = 10;
+    const char*    json        = nullptr;
+    Vector<String> corpus;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json = argv[++i];
+        else if(strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+            corpus.push_back(argv[++i]);
+        else
+            repetitions = unsigned(std::max(1, atoi(argv[i])));
+    }
+
+    bench_load(repetitions);
+    bench_dispatch(repetitions);
+    bench_parse(repetitions);
+    bench_nesting(repetitions);
+    bench_print(repetitions);
+    bench_end_to_end(repetitions);
+
+    if(!corpus.empty())
+        bench_corpus(repetitions, corpus);
+
+    if(json && !write_json(json, repetitions))
+    {
+        printf("Could not write %s.\n", json);
+        return 1;
+    }
+
+    return 0;
+}
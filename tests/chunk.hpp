@@ -0,0 +1,156 @@
+#ifndef LUA4DEC_TESTS_CHUNK_H
+#define LUA4DEC_TESTS_CHUNK_H
+
+#include "lua/lua.hpp"
+
+/*
+ * Encode instructions
+ */
+
+inline Instruction encode(Operator op)
+{
+    return Instruction(op);
+}
+
+inline Instruction encode_u(Operator op, unsigned u)
+{
+    return Instruction(op) | (u << BIT_SHIFT_U);
+}
+
+inline Instruction encode_s(Operator op, int s)
+{
+    return encode_u(op, unsigned(s + (std::numeric_limits<int>::max() >> BIT_SHIFT_S)));
+}
+
+inline Instruction encode_ab(Operator op, unsigned a, unsigned b)
+{
+    return Instruction(op) | (b << BIT_SHIFT_B) | (a << BIT_SHIFT_A);
+}
+
+/*
+ * Serializes functions into lua 4 bytecode of any layout. Used to generate synthetic
+ * chunks for tests and benchmarks.
+ */
+class ChunkWriter
+{
+public:
+    ChunkWriter(
+        Byte bytes_for_size_t = 8,
+        Byte bytes_for_number = 8,
+        bool little_endian    = true)
+        : m_bytes_for_size_t(bytes_for_size_t)
+        , m_bytes_for_number(bytes_for_number)
+        , m_little_endian(little_endian)
+    {
+    }
+
+    Vector<Byte> write(const Function& main)
+    {
+        m_bytes.clear();
+
+        for(Byte b : {0x1B, 0x4C, 0x75, 0x61, 0x40})
+            byte(b);
+
+        byte(m_little_endian ? 0x01 : 0x00);
+        byte(sizeof(Int));
+        byte(m_bytes_for_size_t);
+        byte(sizeof(Instruction));
+        byte(BITS_I);
+        byte(BITS_OP);
+        byte(BITS_B);
+        byte(m_bytes_for_number);
+        number(LUA_NUMBER);
+
+        function(main);
+
+        return m_bytes;
+    }
+
+private:
+    void byte(Byte value)
+    {
+        m_bytes.push_back(value);
+    }
+
+    template<typename T>
+    void value(T value)
+    {
+        if(m_little_endian != HOST_IS_LITTLE_ENDIAN)
+            value = swap_bytes(value);
+
+        const auto* bytes = reinterpret_cast<const Byte*>(&value);
+        m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(T));
+    }
+
+    void integer(int v)
+    {
+        value<Int>(v);
+    }
+
+    void size(size_t v)
+    {
+        if(m_bytes_for_size_t == 4)
+            value<uint32_t>(uint32_t(v));
+        else
+            value<uint64_t>(v);
+    }
+
+    void number(Number v)
+    {
+        if(m_bytes_for_number == 4)
+            value<float>(float(v));
+        else
+            value<double>(v);
+    }
+
+    void string(StringView str)
+    {
+        size(str.size() + 1);
+        m_bytes.insert(m_bytes.end(), str.begin(), str.end());
+        byte(0);  // zero
+    }
+
+    void function(const Function& f)
+    {
+        string(f.name);
+        integer(f.line_defined);
+        integer(f.number_of_params);
+        byte(f.is_variadic ? 0x01 : 0x00);
+        integer(f.max_stack_size);
+
+        integer(int(f.locals.size()));
+        for(const auto& local : f.locals)
+        {
+            string(local.name);
+            integer(local.start_pc);
+            integer(local.end_pc);
+        }
+
+        integer(int(f.lines.size()));
+        for(const auto& line : f.lines)
+            integer(line);
+
+        integer(int(f.globals.size()));
+        for(const auto& global : f.globals)
+            string(global);
+
+        integer(int(f.numbers.size()));
+        for(const auto& n : f.numbers)
+            number(n);
+
+        integer(int(f.functions.size()));
+        for(const auto& nested : f.functions)
+            function(nested);
+
+        integer(int(f.instructions.size()));
+        for(const auto& instruction : f.instructions)
+            value<Instruction>(instruction);
+    }
+
+    Byte         m_bytes_for_size_t;
+    Byte         m_bytes_for_number;
+    bool         m_little_endian;
+    Vector<Byte> m_bytes;
+};
+
+#endif  // LUA4DEC_TESTS_CHUNK_H
@@ -0,0 +1,484 @@
+#include "chunk.hpp"
+#include "lua4dec.hpp"
+#include "server/server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/*
+ * Loads valid, truncated, and corrupted chunks. A malformed chunk has to be reported
+ * with a status and the offset of the offending byte, without exiting or reading past
+ * the end of the input.
+ */
+
+static unsigned failures = 0;
+
+static void expect(bool condition, const char* name, size_t detail = 0)
+{
+    if(!condition)
+    {
+        printf("ERR %s (%zu)\n", name, detail);
+        failures += 1;
+    }
+}
+
+static Function test_function()
+{
+    Function nested;
+    nested.name           = "@nested.lua";
+    nested.max_stack_size = 1;
+    nested.numbers        = {3.5};
+    nested.instructions   = {encode_u(Operator::PUSHNUM, 0), encode(Operator::END)};
+
+    Function main;
+    main.name           = "@main.lua";
+    main.max_stack_size = 2;
+    main.locals         = {Local{"x", 2, 6}};
+    main.lines          = {1, 2, 3};
+    main.globals        = {"print", "y"};
+    main.numbers        = {1.25};
+    main.functions      = {nested};
+    main.instructions   = {
+        encode_s(Operator::PUSHINT, 7),
+        encode_u(Operator::PUSHSTRING, 1),
+        encode_u(Operator::SETGLOBAL, 1),
+        encode_ab(Operator::CLOSURE, 0, 0),
+        encode_u(Operator::SETGLOBAL, 0),
+        encode(Operator::END),
+    };
+
+    return main;
+}
+
+static Error load(const Vector<Byte>& bytes, Chunk& chunk)
+{
+    // A copy on the heap, so that reading past the end can be detected by sanitizers.
+    auto* copy = new Byte[bytes.size()];
+    std::copy(bytes.begin(), bytes.end(), copy);
+
+    auto error = read_chunk(copy, bytes.size(), chunk);
+
+    delete[] copy;
+    return error;
+}
+
+static void test_layouts()
+{
+    for(Byte size_t_bytes : {4, 8})
+    {
+        for(Byte number_bytes : {4, 8})
+        {
+            for(bool little_endian : {true, false})
+            {
+                const auto bytes = ChunkWriter(size_t_bytes, number_bytes, little_endian)
+                                       .write(test_function());
+
+                Chunk chunk;
+                auto  error = load(bytes, chunk);
+
+                expect(error.status == Status::OK, "layout loads", size_t_bytes);
+                expect(error.offset == bytes.size(), "layout is read completely");
+                expect(chunk.main.functions.size() == 1, "layout nested function");
+                expect(chunk.main.globals.size() == 2, "layout globals");
+                expect(chunk.main.code.size() == 6, "layout instructions");
+            }
+        }
+    }
+}
+
+static void test_truncated()
+{
+    const auto bytes = ChunkWriter(8, 8, true).write(test_function());
+
+    for(size_t size = 0; size < bytes.size(); ++size)
+    {
+        Chunk chunk;
+        auto  error = load(Vector<Byte>(bytes.begin(), bytes.begin() + size), chunk);
+
+        expect(error.status != Status::OK, "truncated chunk is rejected", size);
+        expect(error.offset <= size, "truncated offset is inside the input", size);
+    }
+}
+
+static void test_corrupted()
+{
+    const auto bytes = ChunkWriter(8, 8, true).write(test_function());
+
+    // Signature
+    {
+        auto corrupted = bytes;
+        corrupted[1]   = 'X';
+
+        Chunk chunk;
+        auto  error = load(corrupted, chunk);
+        expect(error.status == Status::SIGNATURE_MISMATCH, "signature");
+        expect(error.offset == 0, "signature offset", error.offset);
+    }
+
+    // Size of size_t
+    {
+        auto corrupted = bytes;
+        corrupted[7]   = 5;
+
+        Chunk chunk;
+        auto  error = load(corrupted, chunk);
+        expect(error.status == Status::ARCHITECTURE_MISMATCH, "size_t size");
+    }
+
+    // Length of the main function name: 8 bytes after the 13 byte header and the number.
+    {
+        const size_t offset    = 13 + 8;
+        auto         corrupted = bytes;
+        corrupted[offset + 7]  = 0x7F;
+
+        Chunk chunk;
+        auto  error = load(corrupted, chunk);
+        expect(error.status == Status::UNEXPECTED_END, "string length");
+    }
+
+    // Constant index of the second instruction (PUSHSTRING 1 -> PUSHSTRING 2).
+    {
+        auto function = test_function();
+        function.instructions.mutable_data()[1] = encode_u(Operator::PUSHSTRING, 2);
+
+        const auto corrupted   = ChunkWriter(8, 8, true).write(function);
+        const auto instruction = corrupted.size() - 5 * sizeof(Instruction);
+
+        Chunk chunk;
+        auto  error = load(corrupted, chunk);
+        expect(error.status == Status::MALFORMED_CHUNK, "constant index");
+        expect(error.offset == instruction, "constant index offset", error.offset);
+    }
+
+    // Stack counts: SETTABLE of no elements, more nils than the stack holds.
+    const Instruction stack_counts[] = {
+        encode_ab(Operator::SETTABLE, 1, 0),
+        encode_u(Operator::PUSHNIL, 3),
+    };
+
+    for(const auto instruction : stack_counts)
+    {
+        auto function = test_function();
+        function.instructions.mutable_data()[1] = instruction;
+
+        const auto corrupted = ChunkWriter(8, 8, true).write(function);
+        const auto offset    = corrupted.size() - 5 * sizeof(Instruction);
+
+        Chunk chunk;
+        auto  error = load(corrupted, chunk);
+        expect(error.status == Status::MALFORMED_CHUNK, "stack count", instruction);
+        expect(error.offset == offset, "stack count offset", error.offset);
+    }
+
+    // Every byte flipped on its own has to be loaded or rejected.
+    for(size_t i = 0; i < bytes.size(); ++i)
+    {
+        for(Byte mask : {0x01, 0x80, 0xFF})
+        {
+            auto corrupted = bytes;
+            corrupted[i] ^= mask;
+
+            Chunk chunk;
+            auto  error = load(corrupted, chunk);
+            expect(error.offset <= corrupted.size(), "flipped byte offset", i);
+        }
+    }
+}
+
+/*
+ * The index has to find the same functions as the loader, and each function loaded on
+ * its own has to equal the one loaded with the whole chunk.
+ */
+static void test_index()
+{
+    for(bool little_endian : {true, false})
+    {
+        auto main = test_function();
+        main.functions.push_back(test_function());
+
+        const auto bytes = ChunkWriter(4, 8, little_endian).write(main);
+
+        // The names are compared, so the bytes have to outlive the chunk.
+        Chunk chunk;
+        read_chunk(bytes.data(), bytes.size(), chunk);
+
+        ChunkIndex index;
+        auto       error = index_chunk(bytes.data(), bytes.size(), index);
+        expect(error.status == Status::OK, "index", little_endian);
+        expect(error.offset == bytes.size(), "index is read completely");
+        expect(index.functions.size() == 4, "index functions", index.functions.size());
+
+        // Pre-order: main, nested, second main, its nested function.
+        const size_t parents[] = {0, 0, 0, 2};
+        const size_t nested[]  = {2, 0, 1, 0};
+        for(size_t i = 0; i < index.functions.size() && i < 4; ++i)
+        {
+            expect(index.functions[i].parent == parents[i], "index parent", i);
+            expect(index.functions[i].num_functions == nested[i], "index nested", i);
+        }
+
+        const Function* functions[] = {
+            &chunk.main,
+            &chunk.main.functions[0],
+            &chunk.main.functions[1],
+            &chunk.main.functions[1].functions[0]};
+
+        for(size_t i = 0; i < index.functions.size() && i < 4; ++i)
+        {
+            Chunk single;
+            error = read_function_at(index, i, single);
+
+            const auto& expected = *functions[i];
+            expect(error.status == Status::OK, "function at", i);
+            expect(single.main.name == expected.name, "function at name", i);
+            expect(single.main.code.op == expected.code.op, "function at code", i);
+            expect(single.main.numbers == expected.numbers, "function at numbers", i);
+            expect(index.functions[i].num_instructions == expected.code.size(), "entry", i);
+            expect(index.functions[i].num_globals == expected.globals.size(), "entry", i);
+        }
+
+        Chunk missing;
+        error = read_function_at(index, index.functions.size(), missing);
+        expect(error.status == Status::FUNCTION_NOT_FOUND, "function not found");
+    }
+
+    // A truncated chunk cannot be indexed.
+    const auto bytes = ChunkWriter(8, 8, true).write(test_function());
+    for(size_t size = 0; size < bytes.size(); ++size)
+    {
+        const auto truncated = Vector<Byte>(bytes.begin(), bytes.begin() + size);
+
+        ChunkIndex index;
+        auto       error = index_chunk(truncated.data(), truncated.size(), index);
+        expect(error.status != Status::OK, "truncated index is rejected", size);
+        expect(error.offset <= size, "truncated index offset", size);
+    }
+}
+
+/*
+ * A chunk with functions nested deeper than MAX_NESTING is rejected before the recursion
+ * of the loader can overflow the stack.
+ */
+static void test_nesting()
+{
+    const auto nest = [](unsigned depth)
+    {
+        auto function = test_function();
+        for(unsigned i = 0; i < depth; ++i)
+        {
+            auto parent = test_function();
+            parent.functions.front() = std::move(function);
+            function = std::move(parent);
+        }
+        return ChunkWriter().write(function);
+    };
+
+    // test_function has a nested function of its own.
+    const auto deepest = nest(MAX_NESTING - 1);
+    const auto deeper  = nest(MAX_NESTING);
+
+    Chunk chunk;
+    auto  error = load(deepest, chunk);
+    expect(error.status == Status::OK, "deepest nesting", size_t(error.status));
+
+    error = load(deeper, chunk);
+    expect(error.status == Status::MALFORMED_CHUNK, "too deep nesting");
+    expect(error.offset < deeper.size(), "too deep nesting offset", error.offset);
+
+    ChunkIndex index;
+    error = index_chunk(deepest.data(), deepest.size(), index);
+    expect(error.status == Status::OK, "deepest nesting index");
+
+    error = index_chunk(deeper.data(), deeper.size(), index);
+    expect(error.status == Status::MALFORMED_CHUNK, "too deep nesting index");
+}
+
+/*
+ * Entries of the result cache are found by key and input size, and the least recently
+ * used entries are evicted first.
+ */
+static void test_cache()
+{
+    const auto directory = fs::temp_directory_path() / "lua4dec-loader-cache";
+    fs::remove_all(directory);
+
+    const auto bytes = ChunkWriter().write(test_function());
+    const auto key   = ResultCache::key(bytes.data(), bytes.size());
+
+    const auto entry = CacheEntry{Status::OK, 0, String(1000, 'x')};
+    auto       cache = ResultCache(directory.string(), 2500);
+
+    CacheEntry found;
+    expect(!cache.load(key, bytes.size(), found), "cache miss");
+    expect(cache.store(key, bytes.size(), entry), "cache store");
+    expect(cache.load(key, bytes.size(), found), "cache hit");
+    expect(found.text == entry.text && found.status == entry.status, "cache entry");
+    expect(!cache.load(key, bytes.size() + 1, found), "cache size mismatch");
+    expect(!cache.load(key + 1, bytes.size(), found), "cache key mismatch");
+
+    // Two entries fit. The first one is used again and the second one is evicted.
+    expect(cache.store(key + 1, 1, entry), "cache store second");
+    expect(cache.load(key, bytes.size(), found), "cache hit first");
+    expect(cache.store(key + 2, 2, entry), "cache store third");
+    expect(cache.load(key, bytes.size(), found), "cache keeps used entry");
+    expect(!cache.load(key + 1, 1, found), "cache evicts unused entry");
+    expect(cache.load(key + 2, 2, found), "cache keeps new entry");
+
+    // A truncated entry claims more text than the file holds, it is removed.
+    for(const auto& file : fs::directory_iterator(directory))
+        fs::resize_file(file.path(), fs::file_size(file.path()) - 1);
+
+    expect(!cache.load(key, bytes.size(), found), "cache truncated entry");
+    expect(!cache.load(key + 2, 2, found), "cache truncated new entry");
+    expect(fs::is_empty(directory), "cache removes truncated entries");
+
+    fs::remove_all(directory);
+}
+
+/*
+ * A full memo forgets the functions that were not reused, and admits new ones.
+ */
+static void test_memo()
+{
+    auto memo       = FunctionMemo(4);
+    auto arena      = AstArena();
+    auto statements = Statements();
+    auto status     = Status::OK;
+
+    for(uint64_t hash = 1; hash <= 4; ++hash)
+        memo.insert(hash, Status::OK, arena, statements);
+
+    memo.insert(1, Status::OK, arena, statements);
+    expect(memo.find(1, status, arena, statements), "memo second parse");
+
+    memo.insert(5, Status::OK, arena, statements);
+    expect(memo.size() == 2, "memo evicts", memo.size());
+    expect(memo.find(1, status, arena, statements), "memo keeps reused function");
+    expect(!memo.find(2, status, arena, statements), "memo evicts unused function");
+}
+
+/*
+ * Two functions that differ in a single column of their decoded code never share a hash.
+ */
+static void test_hashes()
+{
+    Chunk chunk;
+    load(ChunkWriter().write(test_function()), chunk);
+
+    auto hashes = FunctionHashes();
+    hash_functions(chunk.main, hashes);
+    const auto hash = hashes.at(&chunk.main);
+
+    for(int column = 0; column < 3; ++column)
+    {
+        auto changed = chunk.main;
+        if(column == 0)
+            changed.code.a[0] += 1;
+        else if(column == 1)
+            changed.code.b[0] += 1;
+        else
+            changed.code.s[0] += 1;
+
+        hash_functions(changed, hashes);
+        expect(hashes.at(&changed) != hash, "hash covers every column", column);
+    }
+}
+
+#ifndef _WIN32
+static void test_server()
+{
+    Function main;
+    main.name           = "@server.lua";
+    main.max_stack_size = 1;
+    main.globals        = {"x"};
+    main.instructions   = {
+        encode_s(Operator::PUSHINT, 7),
+        encode_u(Operator::SETGLOBAL, 0),
+        encode(Operator::END),
+    };
+
+    const auto path  = (fs::temp_directory_path() / "lua4dec-loader.sock").string();
+    const auto bytes = ChunkWriter().write(main);
+    const auto chunk = StringView(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+    const auto* socket = path.c_str();
+
+    // The same chunk decompiled in this process.
+    auto ast      = AstArena();
+    auto expected = StringBuffer();
+    auto local    = decompile_to_text(bytes.data(), bytes.size(), ast, expected);
+
+    auto pool   = ThreadPool(2);
+    auto server = DecompileServer(path, pool);
+    expect(server.listen(), "server listen");
+
+    auto serving = std::thread([&server] { server.serve(); });
+
+    // Clients that connect and send nothing do not hold the workers.
+    sockaddr_un address = {};
+    address.sun_family  = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+    int idle[4];
+    for(auto& client : idle)
+    {
+        client = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    String text;
+    auto   error = request_decompile(socket, RequestKind::CHUNK, chunk, text);
+    expect(local.status == Status::OK && error.status == Status::OK, "server chunk");
+
+    const auto waited = std::chrono::steady_clock::now() - start;
+    expect(waited < std::chrono::seconds(DecompileServer::IDLE_SECONDS / 2), "server idle");
+    expect(text == expected.view() && !text.empty(), "server text");
+
+    error = request_decompile(socket, RequestKind::CHUNK, chunk.substr(0, 20), text);
+    expect(error.status == Status::UNEXPECTED_END, "server truncated chunk");
+
+    error = request_decompile(socket, RequestKind::PATH, "/nonexistent.out", text);
+    expect(error.status == Status::FILE_NOT_READABLE, "server missing file");
+
+    for(const auto client : idle)
+        close(client);
+
+    server.stop();
+    serving.join();
+
+    error = request_decompile(socket, RequestKind::CHUNK, chunk, text);
+    expect(error.status == Status::FILE_NOT_READABLE, "server stopped");
+}
+#endif
+
+int main()
+{
+    test_layouts();
+    test_truncated();
+    test_corrupted();
+    test_index();
+    test_nesting();
+    test_cache();
+    test_memo();
+    test_hashes();
+#ifndef _WIN32
+    test_server();
+#endif
+
+    if(failures == 0)
+        printf("OK  loader\n");
+
+    return failures == 0 ? 0 : 1;
+}
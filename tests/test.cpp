@@ -89,15 +89,14 @@ int main(int argc, char** argv)
 
         if(ext.compare(".out") == 0)
         {
-            auto* ast   = new Ast();
-            Status error = create_ast(ast, file.c_str());
+            AstArena ast;
+            Status   error = create_ast(ast, file.c_str());
 
             StringBuffer stream;
             print_ast(ast, stream);
             auto text = stream.str();
 
             results[stem][1] = Buffer(text.begin(), text.end());
-            delete_ast(ast);
 
             printf("%s %s\n", error == Status::OK ? OK : ERR, file.c_str());
         }